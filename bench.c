@@ -0,0 +1,425 @@
+/* MIT License
+
+Copyright (c) 2019 Joan Bruguera Micó
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+/// Benchmarks the hot paths of the generator: the modular arithmetic, the primality tests,
+/// the safe prime search, the digit extraction of each division strategy, the output of
+/// each format, and the library. Prints the results as JSON, to track them across releases.
+/// It is built with the same configuration as sophie.c, which is included here with its
+/// command line interface, whose entry point is renamed so the one of the benchmarks is used
+#define main sophie_main
+#include "sophie.c"
+#undef main
+
+/// Minimum time during which each benchmark is repeated, in nanoseconds
+#define BENCH_MIN_NS ((uint64_t)200000000)
+
+/// Number of seeds (spread across the seed range) whose safe primes are searched
+#define BENCH_SEARCH_SEEDS 64
+
+/// Number of observations generated at once by the output and library benchmarks
+#define BENCH_OBSERVATIONS ((size_t)(NUM_OBSERVATIONS_MAX < 65536 ? NUM_OBSERVATIONS_MAX : 65536))
+
+/// Keeps the results of the benchmarks alive, so the compiler doesn't optimize them away
+static volatile uint64_t bench_sink;
+
+/// Benchmark, which runs the given number of operations of a kernel, and returns the number
+/// of bytes they produce (or 0 if that's not meaningful for the kernel)
+struct bench {
+    const char *name;
+    uint64_t (*run)(const struct bench *bench, uint64_t num_ops);
+    /// Parameters of the kernel
+    num_t q;
+    int variant;
+};
+
+/// Chained Montgomery modular multiplications, so their latency is measured
+static uint64_t bench_montgomery_mul(const struct bench *bench, uint64_t num_ops) {
+    struct montgomery mont = init_montgomery(bench->q);
+    num_t x = montgomery_from(&mont, 3), y = montgomery_from(&mont, (num_t)(bench->q - 2));
+    for (uint64_t i = 0; i < num_ops; i++) {
+        x = montgomery_mul(&mont, x, y);
+    }
+    bench_sink = x;
+    return 0;
+}
+
+/// Montgomery modular exponentiations with a full-sized exponent
+static uint64_t bench_montgomery_pow(const struct bench *bench, uint64_t num_ops) {
+    struct montgomery mont = init_montgomery(bench->q);
+    num_t x = 0;
+    for (uint64_t i = 0; i < num_ops; i++) {
+        x = (num_t)(x ^ montgomery_pow(&mont, montgomery_from(&mont, (num_t)(2 + i % 64)),
+                                      (num_t)(bench->q - 1)));
+    }
+    bench_sink = x;
+    return 0;
+}
+
+/// Jumps ahead of the expansion to observations spread across the observation range,
+/// with the kernel picked for bench->q
+static uint64_t bench_jump_ahead(const struct bench *bench, uint64_t num_ops) {
+    num_t x = 0;
+    for (uint64_t i = 0; i < num_ops; i++) {
+        x = (num_t)(x ^ jump_ahead_remainder(bench->q, (num_t)(NUM_OBSERVATIONS_MAX - i % 4096)));
+    }
+    bench_sink = x;
+    return 0;
+}
+
+/// Primality tests of the given engine (the variant) on a prime (the worst case), or on
+/// consecutive odd numbers after it if q == 0, which are mostly composite (the usual case)
+static uint64_t bench_primality_test(const struct bench *bench, uint64_t num_ops) {
+    uint64_t num_primes = 0;
+    num_t start = bench->q != 0 ? bench->q : (num_t)(seed_min_q(SEED_MAX / 2) | 1);
+    for (uint64_t i = 0; i < num_ops; i++) {
+        num_t candidate = bench->q != 0 ? start : (num_t)(start + 2 * (i % 65536));
+        num_primes += primality_test((enum primality_engine)bench->variant, candidate);
+    }
+    bench_sink = num_primes;
+    return 0;
+}
+
+/// Searches of the safe primes of seeds spread across the seed range, one per operation
+static uint64_t bench_seed_search(const struct bench *bench, uint64_t num_ops) {
+    num_t sum = 0;
+    for (uint64_t i = 0; i < num_ops; i++) {
+        num_t seed = (num_t)(i % BENCH_SEARCH_SEEDS * SEED_MAX / (BENCH_SEARCH_SEEDS - 1));
+        sum = (num_t)(sum + generate_sophie_germain_safe_prime(seed_min_q(seed),
+                                                                (enum primality_engine)bench->variant));
+    }
+    bench_sink = sum;
+    return 0;
+}
+
+/// Extraction of the observations with the given division strategy (the variant)
+static uint64_t bench_extract(const struct bench *bench, uint64_t num_ops) {
+    struct expansion expansion = init_expansion(bench->q, (enum division_strategy)bench->variant);
+    num_t r = 1, sum = 0;
+    for (uint64_t i = 0; i < num_ops; i++) {
+        sum = (num_t)(sum + extract_observation(&expansion, &r));
+    }
+    bench_sink = sum;
+    return num_ops * NUM_DIGITS_PER_OBSERVATION;
+}
+
+/// Extraction of the observations with the general reciprocal of q, that is, with
+/// the division strategy reciprocal when q does not support the narrow reciprocal
+static uint64_t bench_extract_general(const struct bench *bench, uint64_t num_ops) {
+    struct expansion expansion = init_expansion(bench->q, DIVISION_RECIPROCAL);
+    expansion.narrow = false;
+    num_t r = 1, sum = 0;
+    for (uint64_t i = 0; i < num_ops; i++) {
+        sum = (num_t)(sum + extract_observation(&expansion, &r));
+    }
+    bench_sink = sum;
+    return num_ops * NUM_DIGITS_PER_OBSERVATION;
+}
+
+/// Kernels which are also compiled for the instruction set extensions that a runtime dispatch
+/// could select (see bench_isa_variants), as the variant: the digit extraction (with the
+/// default division strategy), the extraction and formatting of the digits of the
+/// observations into a buffer, and the Miller-Rabin test of q with the first witness
+static inline __attribute__((always_inline)) uint64_t bench_isa(const struct bench *bench, uint64_t num_ops) {
+    struct expansion expansion = init_expansion(bench->q, DIVISION_RECIPROCAL);
+    num_t r = 1, sum = 0;
+    if (bench->variant == 0) {
+        for (uint64_t i = 0; i < num_ops; i++) {
+            sum = (num_t)(sum + extract_observation(&expansion, &r));
+        }
+        bench_sink = sum;
+        return num_ops * NUM_DIGITS_PER_OBSERVATION;
+    } else if (bench->variant == 1) {
+        static char buffer[BENCH_OBSERVATIONS * NUM_DIGITS_PER_OBSERVATION];
+        for (uint64_t i = 0; i < num_ops; i++) {
+            format_observation_chunk(extract_observation(&expansion, &r),
+                                     buffer + i % BENCH_OBSERVATIONS * NUM_DIGITS_PER_OBSERVATION);
+        }
+        bench_sink = (uint64_t)buffer[num_ops % BENCH_OBSERVATIONS * NUM_DIGITS_PER_OBSERVATION];
+        return num_ops * NUM_DIGITS_PER_OBSERVATION;
+    } else {
+        struct rm_candidate candidate = init_rm_candidate(bench->q);
+        uint64_t num_passed = 0;
+        for (uint64_t i = 0; i < num_ops; i++) {
+            num_passed += test_rm_witness(&candidate, 2);
+        }
+        bench_sink = num_passed;
+        return 0;
+    }
+}
+
+__attribute__((flatten))
+static uint64_t bench_isa_scalar(const struct bench *bench, uint64_t num_ops) {
+    return bench_isa(bench, num_ops);
+}
+
+__attribute__((flatten, target("bmi2,adx")))
+static uint64_t bench_isa_bmi2(const struct bench *bench, uint64_t num_ops) {
+    return bench_isa(bench, num_ops);
+}
+
+__attribute__((flatten, target("avx2,bmi2,adx")))
+static uint64_t bench_isa_avx2(const struct bench *bench, uint64_t num_ops) {
+    return bench_isa(bench, num_ops);
+}
+
+__attribute__((flatten, target("avx512f,avx512vl,avx512ifma,bmi2,adx")))
+static uint64_t bench_isa_avx512ifma(const struct bench *bench, uint64_t num_ops) {
+    return bench_isa(bench, num_ops);
+}
+
+static bool bench_isa_bmi2_supported(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+}
+
+static bool bench_isa_avx2_supported(void) {
+    return bench_isa_bmi2_supported() && __builtin_cpu_supports("avx2");
+}
+
+static bool bench_isa_avx512ifma_supported(void) {
+    return bench_isa_bmi2_supported() && __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512ifma");
+}
+
+/// Builds of bench_isa for the instruction set extensions (which are only run if the CPU
+/// supports them), to measure whether selecting the scalar kernels at runtime would pay off.
+/// Their code is the same, so any difference comes from the instructions that the compiler
+/// picks, e.g. mulx for the double-width multiplications of the reciprocal and Montgomery
+static const struct bench_isa_variant {
+    const char *name;
+    uint64_t (*run)(const struct bench *bench, uint64_t num_ops);
+    bool (*supported)(void);
+} bench_isa_variants[] = {
+    { "scalar", bench_isa_scalar, lane_kernel_always_supported },
+    { "bmi2", bench_isa_bmi2, bench_isa_bmi2_supported },
+    { "avx2", bench_isa_avx2, bench_isa_avx2_supported },
+    { "avx512ifma", bench_isa_avx512ifma, bench_isa_avx512ifma_supported },
+};
+
+/// End-to-end generation of the observations (with the default division strategy)
+/// in the given output format (the variant), written to /dev/null
+static uint64_t bench_output(const struct bench *bench, uint64_t num_ops) {
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    struct output output;
+    if (fd == -1 || !output_init(&output, fd, false)) {
+        perror("Failed to open the output of the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    struct expansion expansion = init_expansion(bench->q, DIVISION_RECIPROCAL);
+    for (uint64_t i = 0; i < num_ops; i += BENCH_OBSERVATIONS) {
+        if (!generate_observations_serial(&expansion, (enum output_format)bench->variant,
+                                          (num_t)BENCH_OBSERVATIONS, 0, &output)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    output_flush(&output);
+    output_free(&output);
+    close(fd);
+    return (num_ops + BENCH_OBSERVATIONS - 1) / BENCH_OBSERVATIONS * BENCH_OBSERVATIONS *
+           output_format_sizes[bench->variant];
+}
+
+/// Generation of the observations through the library, into a buffer, as doubles with a
+/// single generator (variant 0), or with the multi-stream kernel for the CPU on as many
+/// generators as its lanes (variant 1), or as integers with the variant - 2 of lane_kernels
+static uint64_t bench_library(const struct bench *bench, uint64_t num_ops) {
+    static double buffers[STREAM_LANES_MAX][BENCH_OBSERVATIONS];
+    static struct sophie_state states[STREAM_LANES_MAX];
+    const struct lane_kernel *kernel = bench->variant <= 1 ? lane_kernel() : &lane_kernels[bench->variant - 2];
+    size_t num_states = bench->variant == 0 ? 1 : kernel->lanes;
+    void *bufs[STREAM_LANES_MAX];
+    for (size_t i = 0; i < num_states; i++) {
+        if (!sophie_init(&states[i], i)) {
+            exit(EXIT_FAILURE);
+        }
+        bufs[i] = buffers[i];
+    }
+    for (uint64_t i = 0; i < num_ops; i += BENCH_OBSERVATIONS * num_states) {
+        if (bench->variant == 0) {
+            sophie_fill_f64(&states[0], buffers[0], BENCH_OBSERVATIONS);
+        } else {
+            fill_streams_with(kernel, states, num_states, bufs, BENCH_OBSERVATIONS, bench->variant == 1);
+        }
+    }
+    bench_sink = (uint64_t)(buffers[0][0] * 1e15);
+    uint64_t block_ops = BENCH_OBSERVATIONS * num_states;
+    return (num_ops + block_ops - 1) / block_ops * block_ops * sizeof(double);
+}
+
+/// Generation of samples through the library, into a buffer: integers in [0, 6) (variant 0),
+/// in [0, 10**12) (variant 1), or 64-bit words of random bits (variant 2)
+static uint64_t bench_library_samples(const struct bench *bench, uint64_t num_ops) {
+    static uint64_t buffer[BENCH_OBSERVATIONS];
+    struct sophie_state state;
+    if (!sophie_init(&state, 0)) {
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < num_ops; i += BENCH_OBSERVATIONS) {
+        if (bench->variant == 2) {
+            sophie_fill_bits(&state, (uint8_t *)buffer, BENCH_OBSERVATIONS * sizeof(uint64_t));
+        } else {
+            sophie_fill_bounded(&state, buffer, BENCH_OBSERVATIONS,
+                                bench->variant == 0 ? 6 : UINT64_C(1000000000000));
+        }
+    }
+    bench_sink = buffer[0];
+    return (num_ops + BENCH_OBSERVATIONS - 1) / BENCH_OBSERVATIONS * BENCH_OBSERVATIONS * sizeof(uint64_t);
+}
+
+/// Random access to the observations through an index of the library, at pseudorandom positions,
+/// with blocks of the default size (variant 0) or of 256 observations (variant 1)
+static uint64_t bench_library_at(const struct bench *bench, uint64_t num_ops) {
+    static struct sophie_index indexes[2];
+    static bool initialized[2];
+    struct sophie_index *index = &indexes[bench->variant];
+    if (!initialized[bench->variant]) {
+        if (!sophie_index_init(index, SEED_MAX / 2, bench->variant == 0 ? 0 :
+                               (NUM_OBSERVATIONS_MAX < 256 ? NUM_OBSERVATIONS_MAX : 256))) {
+            exit(EXIT_FAILURE);
+        }
+        initialized[bench->variant] = true;
+    }
+
+    uint64_t position = 0x9E3779B97F4A7C15, sum = 0, observation = 0;
+    for (uint64_t i = 0; i < num_ops; i++) {
+        position = position * 6364136223846793005 + 1442695040888963407;
+        sophie_at(index, (position >> 32) % NUM_OBSERVATIONS_MAX, &observation);
+        sum += observation;
+    }
+    bench_sink = sum;
+    return num_ops * NUM_DIGITS_PER_OBSERVATION;
+}
+
+/// Runs a benchmark with an increasing number of operations, until it takes at least
+/// BENCH_MIN_NS, and prints its result as a JSON object
+static void run_bench(const struct bench *bench, bool first) {
+    uint64_t num_ops = 1, num_bytes, elapsed_ns;
+    for (;; num_ops *= 2) {
+        uint64_t start_ns = monotonic_ns();
+        num_bytes = bench->run(bench, num_ops);
+        elapsed_ns = monotonic_ns() - start_ns;
+        if (elapsed_ns >= BENCH_MIN_NS) {
+            break;
+        }
+    }
+
+    printf("%s    {\"name\": \"%s\", \"operations\": %" PRIu64 ", \"seconds\": %.9f, "
+           "\"ns_per_operation\": %.3f, \"operations_per_second\": %.0f, \"bytes_per_second\": %.0f}",
+           first ? "" : ",\n", bench->name, num_ops, (double)elapsed_ns * 1e-9,
+           (double)elapsed_ns / (double)num_ops, per_second(num_ops, elapsed_ns),
+           per_second(num_bytes, elapsed_ns));
+    fflush(stdout);
+}
+
+/// Entry point of the benchmarks. Runs all the benchmarks whose name starts with the given
+/// prefix (or all of them), and prints their results as a JSON object
+int main(int argc, char *argv[]) {
+    check_configuration();
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [benchmark_name_prefix]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *prefix = argc == 2 ? argv[1] : "";
+
+    // The safe prime of the middle seed, which is representative of the generated expansions
+    num_t q = generate_sophie_germain_safe_prime(seed_min_q(SEED_MAX / 2), PRIMALITY_MINIMAL);
+    struct bench benches[] = {
+        { "montgomery_mul", bench_montgomery_mul, q, 0 },
+        { "montgomery_pow", bench_montgomery_pow, q, 0 },
+        { "jump_ahead", bench_jump_ahead, q, 0 },
+        { "primality_test/reference/prime", bench_primality_test, q, PRIMALITY_REFERENCE },
+        { "primality_test/reference/odd", bench_primality_test, 0, PRIMALITY_REFERENCE },
+        { "primality_test/minimal/prime", bench_primality_test, q, PRIMALITY_MINIMAL },
+        { "primality_test/minimal/odd", bench_primality_test, 0, PRIMALITY_MINIMAL },
+        { "primality_test/bpsw/prime", bench_primality_test, q, PRIMALITY_BPSW },
+        { "primality_test/bpsw/odd", bench_primality_test, 0, PRIMALITY_BPSW },
+        { "seed_search/reference", bench_seed_search, q, PRIMALITY_REFERENCE },
+        { "seed_search/minimal", bench_seed_search, q, PRIMALITY_MINIMAL },
+        { "seed_search/bpsw", bench_seed_search, q, PRIMALITY_BPSW },
+        { "extract/digit", bench_extract, q, DIVISION_DIGIT },
+        { "extract/chunk", bench_extract, q, DIVISION_CHUNK },
+        { "extract/reciprocal", bench_extract, q, DIVISION_RECIPROCAL },
+        { "extract/reciprocal/general", bench_extract_general, q, 0 },
+        { "output/text", bench_output, q, FORMAT_TEXT },
+        { "output/f64", bench_output, q, FORMAT_F64 },
+        { "output/u64", bench_output, q, FORMAT_U64 },
+        { "output/digits", bench_output, q, FORMAT_DIGITS },
+        { "library/fill_f64", bench_library, q, 0 },
+        { "library/fill_streams_f64", bench_library, q, 1 },
+        { "library/fill_bounded/6", bench_library_samples, q, 0 },
+        { "library/fill_bounded/1e12", bench_library_samples, q, 1 },
+        { "library/fill_bits", bench_library_samples, q, 2 },
+        { "library/at", bench_library_at, q, 0 },
+        { "library/at/block_256", bench_library_at, q, 1 },
+    };
+
+    // The integer output of every variant of the multi-stream kernel supported by the CPU
+    struct bench kernel_benches[ARRAY_SIZE(lane_kernels)];
+    char kernel_names[ARRAY_SIZE(lane_kernels)][64];
+    size_t num_kernel_benches = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(lane_kernels); i++) {
+        if (lane_kernels[i].supported()) {
+            snprintf(kernel_names[num_kernel_benches], sizeof(kernel_names[0]),
+                     "library/fill_streams_u64/%s", lane_kernels[i].name);
+            kernel_benches[num_kernel_benches] = (struct bench){
+                kernel_names[num_kernel_benches], bench_library, q, (int)i + 2
+            };
+            num_kernel_benches++;
+        }
+    }
+
+    // Every kernel of bench_isa, for each of its builds which the CPU supports
+    static const char *isa_kernels[] = { "extract", "format", "miller_rabin" };
+    struct bench isa_benches[ARRAY_SIZE(isa_kernels) * ARRAY_SIZE(bench_isa_variants)];
+    char isa_names[ARRAY_SIZE(isa_benches)][64];
+    size_t num_isa_benches = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(isa_kernels); i++) {
+        for (size_t j = 0; j < ARRAY_SIZE(bench_isa_variants); j++) {
+            if (bench_isa_variants[j].supported()) {
+                snprintf(isa_names[num_isa_benches], sizeof(isa_names[0]), "isa/%s/%s",
+                         isa_kernels[i], bench_isa_variants[j].name);
+                isa_benches[num_isa_benches] = (struct bench){
+                    isa_names[num_isa_benches], bench_isa_variants[j].run, q, (int)i
+                };
+                num_isa_benches++;
+            }
+        }
+    }
+
+    size_t num_lanes;
+    const char *kernel_name = sophie_stream_kernel(&num_lanes);
+    printf("{\"num_bits\": %zu, \"q\": %" PRInum ", \"stream_kernel\": \"%s\", \"stream_lanes\": %zu, "
+           "\"results\": [\n", sizeof(num_t) * CHAR_BIT, q, kernel_name, num_lanes);
+    bool first = true;
+    for (size_t i = 0; i < ARRAY_SIZE(benches) + num_kernel_benches + num_isa_benches; i++) {
+        const struct bench *bench = i < ARRAY_SIZE(benches) ? &benches[i] :
+                                    i < ARRAY_SIZE(benches) + num_kernel_benches ?
+                                    &kernel_benches[i - ARRAY_SIZE(benches)] :
+                                    &isa_benches[i - ARRAY_SIZE(benches) - num_kernel_benches];
+        if (strncmp(bench->name, prefix, strlen(prefix)) == 0) {
+            run_bench(bench, first);
+            first = false;
+        }
+    }
+    printf("\n]}\n");
+    return EXIT_SUCCESS;
+}
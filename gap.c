@@ -0,0 +1,221 @@
+/* MIT License
+
+Copyright (c) 2019 Joan Bruguera Micó
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+/// Computes the maximal gap between consecutive Sophie-Germain safe primes (with a maximally
+/// periodic reciprocal, as the generator uses) in a range, in order to compute or validate
+/// NUM_PRIME_GERMAIN_GAP_MAX for a configuration of the generator.
+/// It is built with the same configuration as sophie.c, which is included here
+#define SOPHIE_LIBRARY
+#include "sophie.c"
+
+/// Number of consecutive integers of the range which are scanned at once by a thread
+#define GAP_SEGMENT_SIZE ((num_t)1 << 24)
+
+/// Segment of the range, with the safe primes found in it
+struct gap_segment {
+    num_t start;
+    num_t end;
+    /// Number of safe primes in the segment
+    size_t count;
+    /// First and last safe primes in the segment (if count > 0)
+    num_t first;
+    num_t last;
+    /// Maximal gap between consecutive safe primes in the segment, and where it starts
+    num_t max_gap;
+    num_t max_gap_start;
+};
+
+/// Scan of the range, shared by all the threads, which take the segments in order
+struct gap_scan {
+    struct gap_segment *segments;
+    size_t num_segments;
+    size_t next_segment;
+};
+
+/// Finds all the safe primes in a segment, which is sieved in a single pass
+/// (the search continues from each safe prime, see next_safe_prime)
+static void scan_gap_segment(struct gap_segment *segment) {
+    struct safe_prime_search search;
+    start_safe_prime_search(&search, segment->start);
+    for (num_t q; (q = next_safe_prime(&search, PRIMALITY_MINIMAL)) != 0 && q < segment->end; ) {
+        if (segment->count == 0) {
+            segment->first = q;
+        } else if ((num_t)(q - segment->last) > segment->max_gap) {
+            segment->max_gap = (num_t)(q - segment->last);
+            segment->max_gap_start = segment->last;
+        }
+        segment->last = q;
+        segment->count++;
+    }
+}
+
+/// Entry point of a thread of the scan, which scans segments until none is left
+static void *run_gap_worker(void *scan_ptr) {
+    struct gap_scan *scan = scan_ptr;
+    size_t index;
+    while ((index = __atomic_fetch_add(&scan->next_segment, 1, __ATOMIC_RELAXED)) < scan->num_segments) {
+        scan_gap_segment(&scan->segments[index]);
+    }
+    return NULL;
+}
+
+/// Parses the specified string into a number
+static bool parse_gap_num(const char *str, num_t *dest) {
+    char trailing_detect;
+    return sscanf(str, "%" SCNnum "%c", dest, &trailing_detect) == 1;
+}
+
+/// Entry point of the tool. Scans the given range (by default, the range of the safe primes
+/// of all the seeds of the configuration, in which case NUM_PRIME_GERMAIN_GAP_MAX is also
+/// checked against the safe primes of all the seeds)
+int main(int argc, char *argv[]) {
+    check_configuration();
+
+    num_t num_threads = 1;
+    int arg_index = 1;
+    if (arg_index + 1 < argc && strcmp(argv[arg_index], "--threads") == 0) {
+        if (!parse_gap_num(argv[arg_index + 1], &num_threads) || num_threads < 1 || num_threads > THREADS_MAX) {
+            arg_index = argc + 1;
+        }
+        arg_index += 2;
+    }
+
+    bool default_range = arg_index == argc;
+    num_t lower_bound = seed_min_q(0), upper_bound = (num_t)(seed_min_q(SEED_MAX) + NUM_PRIME_GERMAIN_GAP_MAX);
+    if (!default_range && (argc - arg_index != 2 || !parse_gap_num(argv[arg_index], &lower_bound) ||
+                           !parse_gap_num(argv[arg_index + 1], &upper_bound) || lower_bound >= upper_bound)) {
+        fprintf(stderr, "Usage: %s [--threads n] [lower_bound upper_bound]\n", argv[0]);
+        fprintf(stderr, "    Computes the maximal gap between the Sophie-Germain safe primes used by\n");
+        fprintf(stderr, "    the generator in [lower_bound, upper_bound) (by default, the range of the\n");
+        fprintf(stderr, "    safe primes of all seeds: [%" PRInum ", %" PRInum "))\n",
+                seed_min_q(0), (num_t)(seed_min_q(SEED_MAX) + NUM_PRIME_GERMAIN_GAP_MAX));
+        fprintf(stderr, "    (where n <= %d)\n", THREADS_MAX);
+        return EXIT_FAILURE;
+    }
+
+    // Split the range into segments, which are scanned by the threads
+    struct gap_scan scan = { NULL, (size_t)((upper_bound - lower_bound - 1) / GAP_SEGMENT_SIZE) + 1, 0 };
+    scan.segments = calloc(scan.num_segments, sizeof(*scan.segments));
+    if (scan.segments == NULL) {
+        fprintf(stderr, "Out of memory allocating %zu segments\n", scan.num_segments);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < scan.num_segments; i++) {
+        scan.segments[i].start = (num_t)(lower_bound + i * GAP_SEGMENT_SIZE);
+        scan.segments[i].end = i + 1 < scan.num_segments ?
+            (num_t)(scan.segments[i].start + GAP_SEGMENT_SIZE) : upper_bound;
+    }
+
+    fprintf(stderr, "Scanning [%" PRInum ", %" PRInum ") with %" PRInum " threads...\n",
+            lower_bound, upper_bound, num_threads);
+    pthread_t threads[THREADS_MAX];
+    size_t num_started = 1;
+    for (; num_started < num_threads; num_started++) {
+        if (pthread_create(&threads[num_started], NULL, run_gap_worker, &scan) != 0) {
+            break;
+        }
+    }
+    run_gap_worker(&scan);
+    for (size_t i = 1; i < num_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Join the segments, including the gaps across their boundaries, and the gap to the first
+    // safe prime after the range, so that every lower bound in the range is covered.
+    // max_distance is the maximal distance from any lower bound in the range to the next safe prime
+    size_t count = 0;
+    bool any_found = false;
+    num_t last = 0, max_gap = 0, max_gap_start = 0, max_distance = 0;
+    for (size_t i = 0; i <= scan.num_segments; i++) {
+        struct gap_segment after = { upper_bound, upper_bound, 0, 0, 0, 0, 0 };
+        if (i == scan.num_segments) {
+            after.first = generate_sophie_germain_safe_prime(upper_bound, PRIMALITY_MINIMAL);
+            after.count = after.first != 0;
+        }
+        const struct gap_segment *segment = i < scan.num_segments ? &scan.segments[i] : &after;
+        if (segment->count == 0) {
+            continue;
+        }
+
+        if (!any_found) {
+            max_distance = (num_t)(segment->first - lower_bound);
+        } else if ((num_t)(segment->first - last) > max_gap) {
+            max_gap = (num_t)(segment->first - last);
+            max_gap_start = last;
+        }
+        if (segment->max_gap > max_gap) {
+            max_gap = segment->max_gap;
+            max_gap_start = segment->max_gap_start;
+        }
+        any_found = true;
+        count += i < scan.num_segments ? segment->count : 0;
+        last = segment->last;
+    }
+    free(scan.segments);
+
+    if (!any_found) {
+        printf("No Sophie-Germain safe prime found from %" PRInum "\n", lower_bound);
+        return EXIT_FAILURE;
+    }
+    if (max_gap > 0 && (num_t)(max_gap - 1) > max_distance) {
+        max_distance = (num_t)(max_gap - 1);
+    }
+    printf("Found %zu Sophie-Germain safe primes in the range\n", count);
+    if (max_gap > 0) {
+        printf("Maximal gap: %" PRInum " (from %" PRInum " to %" PRInum ")\n",
+               max_gap, max_gap_start, (num_t)(max_gap_start + max_gap));
+    }
+    printf("Maximal distance from a lower bound in the range to the next safe prime: %" PRInum "\n",
+           max_distance);
+    if (!default_range) {
+        return EXIT_SUCCESS;
+    }
+
+    // The constant only needs to cover the distance from the lower bound of each seed to its safe
+    // prime, which is usually less than the maximal distance from an arbitrary lower bound
+    num_t *qs = malloc((SEED_MAX + 1) * sizeof(*qs));
+    if (qs == NULL || !search_seeds(0, SEED_MAX + 1, qs, PRIMALITY_MINIMAL, (size_t)num_threads)) {
+        fprintf(stderr, "Failed searching the safe primes of the seeds\n");
+        return EXIT_FAILURE;
+    }
+    num_t max_seed_distance = 0, max_seed = 0;
+    for (num_t seed = 0; seed <= SEED_MAX; seed++) {
+        if ((num_t)(qs[seed] - seed_min_q(seed)) > max_seed_distance) {
+            max_seed_distance = (num_t)(qs[seed] - seed_min_q(seed));
+            max_seed = seed;
+        }
+        // Those seeds are rejected by the generator, since their safe prime isn't valid
+        if (!valid_seed_q(seed, qs[seed])) {
+            printf("Seed %" PRInum " has its safe prime beyond NUM_PRIME_GERMAIN_GAP_MAX (at %" PRInum ")\n",
+                   seed, (num_t)(qs[seed] - seed_min_q(seed)));
+        }
+    }
+    free(qs);
+    printf("Maximal distance from the lower bound of a seed to its safe prime: %" PRInum " (seed %" PRInum ")\n",
+           max_seed_distance, max_seed);
+
+    bool valid = max_seed_distance <= NUM_PRIME_GERMAIN_GAP_MAX;
+    printf("NUM_PRIME_GERMAIN_GAP_MAX = %" PRInum " is %s for this configuration%s\n",
+           (num_t)NUM_PRIME_GERMAIN_GAP_MAX, valid ? "valid" : "NOT valid",
+           valid ? "" : " (some seeds have their safe prime beyond it)");
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
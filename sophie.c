@@ -22,12 +22,31 @@ SOFTWARE.
 */
 /// Generates an uniform sample, using a pseudorandom number generator
 /// based on Sophie-Germain safe primes
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <limits.h>
+#include <string.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "sophie.h"
 
 /**************************
  * CONFIGURATION / LIMITS *
@@ -49,6 +68,13 @@ SOFTWARE.
 #define SEED_MAX ((num_t)UINT16_MAX)
 
 #define NUM_DIGITS_PER_OBSERVATION 15
+#define POW10_DIGITS_PER_OBSERVATION ((num_t)1000000000000000)
+
+/// Number of digits which are extracted per long division step in the multi-stream
+/// kernel, which must divide NUM_DIGITS_PER_OBSERVATION. The kernel is exact for
+/// q * 10**STREAM_DIGITS_PER_STEP < 2**53, which holds for q < 9*10**10
+#define STREAM_DIGITS_PER_STEP 5
+#define POW10_STREAM_DIGITS_PER_STEP ((num_t)100000)
 
 /// This is the maximum distance between two Sophie-Germain safe primes
 /// (similar to the 'maximal prime gap' concept but with Sophie-Germain safe primes)
@@ -59,7 +85,9 @@ SOFTWARE.
 /// NUM_OBSERVATIONS_MAX + (s+1) * NUM_PRIME_GERMAIN_GAP_MAX,
 /// for 0 <= s <= SEED_MAX, so that for any admissible value of s,
 /// we can generate a single Sophie-Germain safe prime, and thus
-/// generate a different pseudorandom sequence
+/// generate a different pseudorandom sequence.
+/// Note that it is exceeded by the seeds 5287 and 52091 (by up to 21013, see sophie-gap),
+/// which are rejected (see valid_seed_q) rather than changing the output of most seeds
 #define NUM_PRIME_GERMAIN_GAP_MAX ((num_t)17904)
 #else
 #define num_t uint16_t
@@ -72,14 +100,94 @@ SOFTWARE.
 #define SEED_MAX ((num_t)15)
 
 #define NUM_DIGITS_PER_OBSERVATION 2
+#define POW10_DIGITS_PER_OBSERVATION ((num_t)100)
+
+#define STREAM_DIGITS_PER_STEP 2
+#define POW10_STREAM_DIGITS_PER_STEP ((num_t)100)
 
 #define NUM_PRIME_GERMAIN_GAP_MAX 616
 #endif
 
+/// Limits of the wide configuration, which is only used by the runs which ask for it (--wide),
+/// so they can exceed the limits above. Its Sophie-Germain safe primes are 128-bit integers (wide_t), though the number of
+/// observations and the seeds still fit 64 bits. Those safe primes are less than 2**69, so the
+/// products of the digit extraction (r * POW10_DIGITS_PER_OBSERVATION) fit 128 bits, and the
+/// Rabin-Miller test with the witnesses of rm_witnesses is deterministic for them
+#define wide_t unsigned __int128
+#define WIDE_NUM_OBSERVATIONS_MAX UINT64_MAX
+#define WIDE_SEED_MAX ((uint64_t)UINT32_MAX)
+
+/// Same as NUM_PRIME_GERMAIN_GAP_MAX, for the wide configuration. Since scanning the range
+/// of all its seeds is not feasible (sophie-gap only scans the default one), it is NOT
+/// validated, nor computed: it is an estimate, about 150 times the average distance from the
+/// lower bound of a seed to its safe prime (about 7000), with no bound proven for it. The seeds
+/// whose safe prime is beyond it, if any, are rejected at runtime (see generate_uniform_sophie_wide)
+#define WIDE_PRIME_GERMAIN_GAP_MAX ((uint64_t)1 << 20)
+
+/// Number of observations that each worker thread generates at once in the
+/// multi-threaded mode. Each thread needs two blocks of lines in memory
+#define THREAD_BLOCK_OBSERVATIONS ((size_t)16384)
+
+/// Maximum number of worker threads in the multi-threaded mode
+#define THREADS_MAX 256
+
+/// Number of observations of the blocks of raw chunks which are passed from the generator
+/// threads to the writer in the pipelined mode, and number of those blocks which are
+/// preallocated for each generator thread (a power of two)
+#define PIPELINE_BLOCK_OBSERVATIONS ((size_t)16384)
+#define PIPELINE_GENERATOR_BLOCKS 4
+
+/// Size of a cache line, to avoid false sharing between the variables of different threads
+#define CACHE_LINE_SIZE 64
+
+/// Capacity of the shared memory ring of each connection of the server mode, the offset
+/// of its data in the shared memory object (after its header), the number of times
+/// a side waits by yielding the processor before sleeping, and how long it sleeps before
+/// checking whether the other end has closed the connection
+#define SHM_RING_CAPACITY ((size_t)1 << 20)
+#define SHM_RING_DATA_OFFSET ((size_t)4096)
+#define SHM_RING_SPINS 1024
+#define SHM_RING_SLEEP_NS 1000000
+
+/// Size of the output buffer, which is written once full
+#define OUTPUT_BUFFER_SIZE ((size_t)1 << 20)
+
+/// Maximum size of the data which can be formatted at once into the output buffer
+#define OUTPUT_RESERVE_MAX ((size_t)4096)
+
+/// Number of consecutive seeds whose safe primes are searched at once in a single pass
+/// of the sieve, when searching the safe primes of many seeds
+#define SEARCH_CHUNK_SEEDS 64
+
+/// Number of consecutive candidates which are sieved at once in the safe prime search
+#define SIEVE_WINDOW_SIZE 2048
+
+/// Upper bound (exclusive) of the small primes used to sieve the candidates in the
+/// safe prime search. Larger primes reject too few candidates to pay off their sieving
+#define SIEVE_PRIME_LIMIT 1024
+
+/// Maximal number of Rabin-Miller witness tests which are interleaved, which must allow
+/// testing the largest set of rm_minimal_witness_sets at once
+#define RM_BATCH_SIZE 8
+
+/// Number of observations after which the state of the run is saved into the checkpoint file
+#define CHECKPOINT_INTERVAL_OBSERVATIONS ((num_t)(NUM_OBSERVATIONS_MAX < (1 << 24) ? 64 : (1 << 24)))
+
+/// Number of observations which are generated between the checks of the end of the period
+/// of the expansion, when generating it without any predefined end (--stream)
+#define UNBOUNDED_BLOCK_OBSERVATIONS ((num_t)(NUM_MAX < 65536 ? 64 : 65536))
+
+/// Number of observations which are generated at once by the multi-stream kernel,
+/// before they are stored into the buffer of each generator
+#define STREAM_BLOCK_OBSERVATIONS 64
+
 /*********************
  * GENERIC UTILITIES *
  *********************/
 
+/// Number of bits of num_t
+#define NUM_BITS (sizeof(num_t) * CHAR_BIT)
+
 /// Returns the number of elements in the specified array
 #define ARRAY_SIZE(x) ((sizeof(x)/sizeof((x)[0])))
 
@@ -101,40 +209,300 @@ static int compare_num(const void *a_ptr, const void *b_ptr) {
     return (a < b) ? -1 : 1;
 }
 
-/// Parses the specified string into a number.
-static bool parse_num(const char *str, num_t *dest) {
-    // Don't allow trailing noise. See https://stackoverflow.com/a/21888827
-    char trailing_detect;
-    return sscanf(str, "%" SCNnum "%c", dest, &trailing_detect) == 1;
+/// Computes (x+y mod p) without overflow, for x, y < p
+static num_t add_mod(num_t x, num_t y, num_t p) {
+    return x >= (num_t)(p - y) ? (num_t)(x - (num_t)(p - y)) : (num_t)(x + y);
 }
 
-/// Computes (x*y mod p) without multiplication potentially causing overflow
-static num_t mul_mod(num_t x, num_t y, num_t p) {
-    return (num_t)(((bignum_t)x * (bignum_t)y) % p);
+/// Computes (x-y mod p) without overflow, for x, y < p
+static num_t sub_mod(num_t x, num_t y, num_t p) {
+    return x >= y ? (num_t)(x - y) : (num_t)(x + (num_t)(p - y));
 }
 
-/// Computes (x**y mod p) efficiently using modular exponentiation
-/// See: https://en.wikipedia.org/wiki/Modular_exponentiation
-static num_t pow_mod(num_t x, num_t y, num_t p) {
-    if (p == 1) {
-        return 0;
+/// Computes (x/2 mod p) without overflow, for x < p and an odd p
+static num_t half_mod(num_t x, num_t p) {
+    return x % 2 == 0 ? (num_t)(x / 2) : (num_t)(x / 2 + p / 2 + 1);
+}
+
+/// Checks if the given number is a perfect square, using the
+/// digit-by-digit algorithm for the integer square root
+/// See: https://en.wikipedia.org/wiki/Methods_of_computing_square_roots#Binary_numeral_system_(base_2)
+static bool is_perfect_square(num_t x) {
+    num_t root = 0;
+    num_t bit = (num_t)((num_t)1 << (NUM_BITS - 2));
+    while (bit > x) {
+        bit = (num_t)(bit >> 2);
+    }
+
+    for (; bit != 0; bit = (num_t)(bit >> 2)) {
+        if (x >= (num_t)(root + bit)) {
+            x = (num_t)(x - (num_t)(root + bit));
+            root = (num_t)((root >> 1) + bit);
+        } else {
+            root = (num_t)(root >> 1);
+        }
+    }
+    return x == 0;
+}
+
+/// Computes the Jacobi symbol (a/n), for an odd n
+/// See: https://en.wikipedia.org/wiki/Jacobi_symbol#Calculating_the_Jacobi_symbol
+static int jacobi_symbol(num_t a, num_t n) {
+    int result = 1;
+    a = (num_t)(a % n);
+    while (a != 0) {
+        while (a % 2 == 0) {
+            a = (num_t)(a / 2);
+            if (n % 8 == 3 || n % 8 == 5) {
+                result = -result;
+            }
+        }
+
+        num_t swap = a;
+        a = n;
+        n = swap;
+        if (a % 4 == 3 && n % 4 == 3) {
+            result = -result;
+        }
+        a = (num_t)(a % n);
+    }
+    return n == 1 ? result : 0;
+}
+
+/// Precomputed reciprocal of a divisor, which allows dividing by it
+/// using multiplications instead of a (much slower) hardware division
+/// See: https://gmplib.org/~tege/division-paper.pdf (Möller & Granlund, 2011)
+struct reciprocal {
+    /// The divisor, shifted left so the most significant bit is set (normalized)
+    num_t divisor;
+    /// floor((2**(2*NUM_BITS) - 1) / divisor) - 2**NUM_BITS
+    num_t inverse;
+    /// Number of bits the divisor has been shifted left
+    unsigned shift;
+};
+
+/// Precomputes the reciprocal of the given (non-zero) divisor
+static struct reciprocal compute_reciprocal(num_t divisor) {
+    struct reciprocal reciprocal = { divisor, 0, 0 };
+    while ((reciprocal.divisor >> (NUM_BITS - 1)) == 0) {
+        reciprocal.divisor = (num_t)(reciprocal.divisor << 1);
+        reciprocal.shift++;
+    }
+    // The quotient is always in [2**NUM_BITS, 2**(NUM_BITS+1)), so truncating subtracts 2**NUM_BITS
+    reciprocal.inverse = (num_t)(~(bignum_t)0 / reciprocal.divisor);
+    return reciprocal;
+}
+
+/// Divides the dividend by the divisor of the given reciprocal, which must be
+/// less than divisor * 2**NUM_BITS (so the quotient fits a num_t). Stores the remainder
+/// into *remainder and returns the quotient.
+/// This is the algorithm 4 of the Möller & Granlund paper, which needs two multiplications
+/// (one of them double-width) and at most two corrections
+static num_t divide_reciprocal(const struct reciprocal *reciprocal, bignum_t dividend,
+                               num_t *remainder) {
+    dividend <<= reciprocal->shift;
+    num_t dividend_high = (num_t)(dividend >> NUM_BITS);
+    num_t dividend_low = (num_t)dividend;
+
+    bignum_t estimate = (bignum_t)reciprocal->inverse * dividend_high + dividend;
+    num_t quotient = (num_t)((estimate >> NUM_BITS) + 1);
+    num_t rem = (num_t)(dividend_low - (num_t)((bignum_t)quotient * reciprocal->divisor));
+    if (rem > (num_t)estimate) {
+        quotient = (num_t)(quotient - 1);
+        rem = (num_t)(rem + reciprocal->divisor);
+    }
+    if (rem >= reciprocal->divisor) {
+        quotient = (num_t)(quotient + 1);
+        rem = (num_t)(rem - reciprocal->divisor);
+    }
+
+    *remainder = (num_t)(rem >> reciprocal->shift);
+    return quotient;
+}
+
+/******************************
+ * PERFORMANCE INSTRUMENTATION *
+ ******************************/
+
+/// Counters of the work done by the safe prime searches, reported by --stats. Since counting
+/// slows down the search, they are only updated when compiled with SOPHIE_STATS
+/// (e.g. with make sophie-stats), and otherwise the counting is compiled out
+struct search_stats {
+    /// Candidates visited from the admissible residue classes of the wheel
+    uint64_t candidates;
+    /// Candidates rejected by the sieve, without any primality test
+    uint64_t sieve_rejections;
+    /// Candidates rejected by the maximally periodic reciprocal condition (p mod 20)
+    uint64_t filter_rejections;
+    /// Candidates rejected by the primality test of q, and by the one of p
+    uint64_t q_rejections;
+    uint64_t p_rejections;
+    /// Primality tests, and Rabin-Miller witnesses evaluated by them
+    uint64_t primality_tests;
+    uint64_t witness_evaluations;
+    /// Safe primes found
+    uint64_t safe_primes;
+};
+
+#ifdef SOPHIE_STATS
+static struct search_stats search_stats;
+#define STATS_ADD(counter, value) \
+    __atomic_fetch_add(&search_stats.counter, (uint64_t)(value), __ATOMIC_RELAXED)
+#else
+#define STATS_ADD(counter, value) ((void)0)
+#endif
+
+/*********************************
+ * MONTGOMERY MODULAR ARITHMETIC *
+ *********************************/
+
+/// Computes the double-width product of two num_t, returning its lower half
+/// and storing its upper half into *high
+static num_t num_mul_full(num_t x, num_t y, num_t *high) {
+    bignum_t product = (bignum_t)x * y;
+    *high = (num_t)(product >> NUM_BITS);
+    return (num_t)product;
+}
+
+/// Precomputed data for the Montgomery modular arithmetic for an odd modulus,
+/// where each x is represented as x*R mod modulus (its Montgomery form), with R = 2**NUM_BITS.
+/// This allows modular multiplications without any double-width division
+/// See: https://en.wikipedia.org/wiki/Montgomery_modular_multiplication
+struct montgomery {
+    num_t modulus;
+    /// modulus**-1 mod R
+    num_t inverse;
+    /// R mod modulus (that is, 1 in Montgomery form)
+    num_t one;
+    /// R**2 mod modulus (used to convert numbers to Montgomery form)
+    num_t r2;
+};
+
+/// Computes t*R**-1 mod modulus (Montgomery reduction), for t = t_high*R + t_low < modulus*R
+static num_t montgomery_reduce(const struct montgomery *mont, num_t t_high, num_t t_low) {
+    // m is picked so that m*modulus has the same lower half as t, thus
+    // (t - m*modulus) / R = t*R**-1 mod modulus, and no carries are involved
+    num_t ignored_high, mp_high;
+    num_t m = num_mul_full(t_low, mont->inverse, &ignored_high);
+    num_mul_full(m, mont->modulus, &mp_high);
+    num_t result = (num_t)(t_high - mp_high);
+    return t_high < mp_high ? (num_t)(result + mont->modulus) : result;
+}
+
+/// Computes (x*y mod modulus) for x and y in Montgomery form
+static num_t montgomery_mul(const struct montgomery *mont, num_t x, num_t y) {
+    num_t high, low = num_mul_full(x, y, &high);
+    return montgomery_reduce(mont, high, low);
+}
+
+/// Precomputes the Montgomery arithmetic data for the given odd modulus
+static struct montgomery init_montgomery(num_t modulus) {
+    struct montgomery mont;
+    num_t ignored_high;
+    mont.modulus = modulus;
+
+    // Newton's iteration for the inverse. The initial guess is correct
+    // for the lowest 3 bits, and each step doubles the number of correct bits
+    mont.inverse = modulus;
+    while (num_mul_full(modulus, mont.inverse, &ignored_high) != 1) {
+        mont.inverse = num_mul_full(mont.inverse,
+            (num_t)(2 - num_mul_full(modulus, mont.inverse, &ignored_high)), &ignored_high);
+    }
+
+    // R**2 mod modulus is 2 in Montgomery form, squared log2(NUM_BITS) times
+    mont.one = (num_t)((num_t)(0 - modulus) % modulus);
+    mont.r2 = mont.one >= (num_t)(modulus - mont.one) ?
+        (num_t)(mont.one - (num_t)(modulus - mont.one)) : (num_t)(mont.one + mont.one);
+    for (unsigned bits = 1; bits < NUM_BITS; bits *= 2) {
+        mont.r2 = montgomery_mul(&mont, mont.r2, mont.r2);
     }
+    return mont;
+}
+
+/// Converts x (< R) to Montgomery form
+static num_t montgomery_from(const struct montgomery *mont, num_t x) {
+    return montgomery_mul(mont, x, mont->r2);
+}
 
-    num_t result = 1;
-    for (num_t curr_x = x % p, curr_y = y;
+/// Computes (x**y mod modulus) for x in Montgomery form
+static num_t montgomery_pow(const struct montgomery *mont, num_t x, num_t y) {
+    num_t result = mont->one;
+    for (num_t curr_x = x, curr_y = y;
          curr_y > 0;
-         curr_x = mul_mod(curr_x, curr_x, p), curr_y /= 2) {
+         curr_x = montgomery_mul(mont, curr_x, curr_x), curr_y /= 2) {
         if (curr_y % 2 == 1) {
-            result = mul_mod(result, curr_x, p);
+            result = montgomery_mul(mont, result, curr_x);
         }
     }
     return result;
 }
 
+/// Computes 10**(observations*NUM_DIGITS_PER_OBSERVATION) mod modulus, for an odd modulus
+static num_t pow10_observations_mod(num_t modulus, num_t observations) {
+    struct montgomery mont = init_montgomery(modulus);
+    num_t pow10 = montgomery_pow(&mont, montgomery_from(&mont, 10), NUM_DIGITS_PER_OBSERVATION);
+    return montgomery_reduce(&mont, 0, montgomery_pow(&mont, pow10, observations));
+}
+
+/// Candidate for the Rabin-Miller primality test, where:
+/// mont is the Montgomery arithmetic data for the candidate (an odd integer > 3)
+/// d and r are such that 2^r*d = p_candidate - 1, with d odd.
+struct rm_candidate {
+    struct montgomery mont;
+    num_t d;
+    num_t r;
+};
+
+/// Prepares the given odd integer > 3 for the Rabin-Miller primality test
+static struct rm_candidate init_rm_candidate(num_t p_candidate) {
+    struct rm_candidate candidate;
+    candidate.mont = init_montgomery(p_candidate);
+    candidate.d = (num_t)(p_candidate - 1);
+    candidate.r = 0;
+    while (candidate.d % 2 == 0) {
+        candidate.r++;
+        candidate.d /= 2;
+    }
+    return candidate;
+}
+
+/// Tests the specified candidate passes the Rabin-Miller primality test for a witness
+/// (which must be less than the candidate). All the arithmetic is done in Montgomery form,
+/// so no conversion back is needed for the comparisons
+/// See: https://en.wikipedia.org/wiki/Miller%E2%80%93Rabin_primality_test
+static bool test_rm_witness(const struct rm_candidate *candidate, num_t witness) {
+    STATS_ADD(witness_evaluations, 1);
+    const struct montgomery *mont = &candidate->mont;
+    num_t mont_minus_one = (num_t)(mont->modulus - mont->one);
+    num_t x = montgomery_pow(mont, montgomery_from(mont, witness), candidate->d);
+    if (x == mont->one || x == mont_minus_one) {
+        return true;
+    }
+
+    for (num_t j = 0; j < (num_t)(candidate->r - 1); j++) {
+        x = montgomery_mul(mont, x, x);
+        if (x == mont_minus_one) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /*******************************************************************
  * IMPLEMENTATION OF THE RABIN-MILLER DETERMINISTIC PRIMALITY TEST *
  *******************************************************************/
 
+/// Engines for the primality tests. All of them are deterministic for all the
+/// (up to 64-bit) inputs, thus they give the same result, but with a different speed
+enum primality_engine {
+    /// Rabin-Miller with all the witnesses of rm_witnesses (reference implementation)
+    PRIMALITY_REFERENCE,
+    /// Rabin-Miller with the smallest known deterministic witness set for the candidate
+    PRIMALITY_MINIMAL,
+    /// Baillie-PSW primality test
+    PRIMALITY_BPSW,
+};
+
 /// List of Rabin-Miller witnesses that ensure (with 100% certainty) that
 /// the Rabin-Miller test works for all 64-bit unsigned integer inputs
 /// See https://en.wikipedia.org/wiki/Miller%E2%80%93Rabin_primality_test#Testing_against_small_sets_of_bases
@@ -142,53 +510,256 @@ static const num_t rm_witnesses[] = {
     2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37
 };
 
-/// Tests the specified candidate passes the Rabin-Miller primality test for a witness, where:
-/// p_candidate is an odd integer > 3 to be tested for primality
-/// d and r are such that 2^r*d = p_candidate - 1, with d odd.
-/// witness is the witness to be checked as a witness for the primality test
-/// See: https://en.wikipedia.org/wiki/Miller%E2%80%93Rabin_primality_test
-static bool test_rm_witness(num_t p_candidate, num_t d, num_t r, num_t witness) {
-    num_t x = pow_mod(witness, d, p_candidate);
-    if (x == 1 || x == p_candidate - 1) {
+/// Smallest known sets of Rabin-Miller witnesses which ensure (with 100% certainty) that
+/// the Rabin-Miller test works for all the inputs below a bound, by increasing bound.
+/// The last set works for all 64-bit unsigned integer inputs
+/// See https://en.wikipedia.org/wiki/Miller%E2%80%93Rabin_primality_test#Testing_against_small_sets_of_bases
+/// See https://miller-rabin.appspot.com/
+static const struct rm_witness_set {
+    uint64_t bound;
+    size_t num_witnesses;
+    uint64_t witnesses[7];
+} rm_minimal_witness_sets[] = {
+    { UINT64_C(2047), 1, { 2 } },
+    { UINT64_C(1373653), 2, { 2, 3 } },
+    { UINT64_C(9080191), 2, { 31, 73 } },
+    { UINT64_C(4759123141), 3, { 2, 7, 61 } },
+    { UINT64_C(1122004669633), 4, { 2, 13, 23, 1662803 } },
+    { UINT64_C(2152302898747), 5, { 2, 3, 5, 7, 11 } },
+    { UINT64_C(3474749660383), 6, { 2, 3, 5, 7, 11, 13 } },
+    { UINT64_C(341550071728321), 7, { 2, 3, 5, 7, 11, 13, 17 } },
+    { UINT64_MAX, 7, { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 } },
+};
+
+/// Checks the primality of the candidates which don't need a primality test,
+/// that is, those which are not greater than the largest reference witness, or even.
+/// Returns true if that's the case, storing whether it is a prime number in *is_prime
+static bool trivial_primality_test(num_t p_candidate, bool *is_prime) {
+    if (p_candidate <= rm_witnesses[ARRAY_SIZE(rm_witnesses)-1]) {
+        *is_prime = bsearch(&p_candidate, rm_witnesses,
+            ARRAY_SIZE(rm_witnesses), sizeof(num_t), compare_num) != NULL;
         return true;
     }
-
-    for (num_t j = 0; j < (num_t)(r - 1); j++) {
-        x = mul_mod(x, x, p_candidate);
-        if (x == p_candidate - 1) {
-            return true;
-        }
+    if (p_candidate % 2 == 0) {
+        *is_prime = false;
+        return true;
     }
-
-   return false;
+    return false;
 }
 
 /// Checks if a given number is a prime number (true) or not (false)
 /// using the Rabin-Miller primality test
 /// See: https://en.wikipedia.org/wiki/Miller%E2%80%93Rabin_primality_test
 static bool rm_primality_test(num_t p_candidate) {
-    if (p_candidate <= rm_witnesses[ARRAY_SIZE(rm_witnesses)-1]) {
-        return bsearch(&p_candidate, rm_witnesses,
-            ARRAY_SIZE(rm_witnesses), sizeof(num_t), compare_num) != NULL;
+    bool is_prime;
+    if (trivial_primality_test(p_candidate, &is_prime)) {
+        return is_prime;
     }
-    if (p_candidate % 2 == 0) {
+
+    struct rm_candidate candidate = init_rm_candidate(p_candidate);
+    for (size_t i = 0; i < ARRAY_SIZE(rm_witnesses); i++) {
+        if (!test_rm_witness(&candidate, rm_witnesses[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Returns the smallest known set of witnesses which is deterministic for the candidate
+static const struct rm_witness_set *rm_minimal_witness_set(num_t p_candidate) {
+    const struct rm_witness_set *set = &rm_minimal_witness_sets[0];
+    while (set != &rm_minimal_witness_sets[ARRAY_SIZE(rm_minimal_witness_sets)-1] &&
+           (uint64_t)p_candidate >= set->bound) {
+        set++;
+    }
+    return set;
+}
+
+/// Rabin-Miller witness test of a candidate, as an element of a batch (see test_rm_witness_batch)
+struct rm_witness_test {
+    const struct rm_candidate *candidate;
+    num_t witness;
+};
+
+/// Checks whether all the given Rabin-Miller witness tests (at most RM_BATCH_SIZE) pass,
+/// as per test_rm_witness. Every multiplication of a single test depends on the previous one,
+/// so its speed is bound by the latency of the multiplier. The tests are independent (even for
+/// the same candidate), thus they are interleaved: each step performs one multiplication for
+/// every test, and the steps which a test doesn't need are computed anyway but discarded.
+/// This evaluates all the witnesses, even when the first one already fails, so it pays off
+/// when the candidates are likely to be primes
+static bool test_rm_witness_batch(const struct rm_witness_test *tests, size_t num_tests) {
+    STATS_ADD(witness_evaluations, num_tests);
+    num_t x[RM_BATCH_SIZE], power[RM_BATCH_SIZE];
+    bool passed[RM_BATCH_SIZE];
+    num_t max_d = 0, max_r = 0;
+    for (size_t i = 0; i < num_tests; i++) {
+        const struct rm_candidate *candidate = tests[i].candidate;
+        x[i] = candidate->mont.one;
+        power[i] = montgomery_from(&candidate->mont, tests[i].witness);
+        max_d = candidate->d > max_d ? candidate->d : max_d;
+        max_r = candidate->r > max_r ? candidate->r : max_r;
+    }
+
+    // x = witness**d with the binary method from the lowest bit (d is odd, thus < NUM_MAX/2)
+    for (num_t bit = 1; bit <= max_d; bit = (num_t)(bit * 2)) {
+        for (size_t i = 0; i < num_tests; i++) {
+            const struct rm_candidate *candidate = tests[i].candidate;
+            num_t product = montgomery_mul(&candidate->mont, x[i], power[i]);
+            x[i] = (candidate->d & bit) != 0 ? product : x[i];
+            power[i] = montgomery_mul(&candidate->mont, power[i], power[i]);
+        }
+    }
+
+    // Once x = -1, the next squarings are 1, so they can't change the result
+    for (size_t i = 0; i < num_tests; i++) {
+        const struct montgomery *mont = &tests[i].candidate->mont;
+        passed[i] = x[i] == mont->one || x[i] == (num_t)(mont->modulus - mont->one);
+    }
+    for (num_t j = 1; j < max_r; j++) {
+        for (size_t i = 0; i < num_tests; i++) {
+            const struct rm_candidate *candidate = tests[i].candidate;
+            x[i] = montgomery_mul(&candidate->mont, x[i], x[i]);
+            passed[i] = passed[i] || (j < candidate->r &&
+                x[i] == (num_t)(candidate->mont.modulus - candidate->mont.one));
+        }
+    }
+
+    bool all_passed = true;
+    for (size_t i = 0; i < num_tests; i++) {
+        all_passed = all_passed && passed[i];
+    }
+    return all_passed;
+}
+
+/// Same as rm_primality_test, but only tests the smallest known set of witnesses
+/// which is deterministic for the magnitude of the candidate. Most composites already fail
+/// for the first witness, so it is tested alone, and then the others are tested at once
+/// (see test_rm_witness_batch), which matters for the primes, where all of them are tested
+static bool rm_minimal_primality_test(num_t p_candidate) {
+    bool is_prime;
+    if (trivial_primality_test(p_candidate, &is_prime)) {
+        return is_prime;
+    }
+
+    // All the witnesses of the set are less than its lower bound, thus than the candidate
+    const struct rm_witness_set *set = rm_minimal_witness_set(p_candidate);
+    struct rm_candidate candidate = init_rm_candidate(p_candidate);
+    if (!test_rm_witness(&candidate, (num_t)set->witnesses[0])) {
         return false;
     }
+    struct rm_witness_test tests[RM_BATCH_SIZE];
+    for (size_t i = 1; i < set->num_witnesses; i++) {
+        tests[i - 1] = (struct rm_witness_test){ &candidate, (num_t)set->witnesses[i] };
+    }
+    return test_rm_witness_batch(tests, set->num_witnesses - 1);
+}
+
+/// Checks if a given odd number, which is not a perfect square, is a strong Lucas
+/// probable prime, with the parameters P and Q chosen by Selfridge's method A
+/// The Lucas sequences are computed in Montgomery form, given the candidate's data
+/// See: https://en.wikipedia.org/wiki/Lucas_pseudoprime#Strong_Lucas_pseudoprimes
+static bool strong_lucas_test(const struct montgomery *mont) {
+    num_t n = mont->modulus;
+
+    // Find the first D in the sequence 5, -7, 9, -11, ... such that (D/n) = -1
+    num_t d_abs = 5;
+    bool d_negative = false;
+    for (;; d_abs = (num_t)(d_abs + 2), d_negative = !d_negative) {
+        num_t d_mod = (num_t)(d_abs % n);
+        int jacobi = jacobi_symbol(d_negative ? (num_t)((n - d_mod) % n) : d_mod, n);
+        if (jacobi == -1) {
+            break;
+        }
+        if (jacobi == 0 && d_mod != 0) {
+            return false; // n shares a non-trivial factor with D
+        }
+    }
+
+    // Lucas parameters P = 1, Q = (1 - D) / 4, in Montgomery form
+    num_t mont_d = montgomery_from(mont, (num_t)(d_abs % n));
+    num_t mont_q = montgomery_from(mont, (num_t)((d_abs / 4 + (d_negative ? 1 : 0)) % n));
+    if (d_negative) {
+        mont_d = sub_mod(0, mont_d, n);
+    } else {
+        mont_q = sub_mod(0, mont_q, n);
+    }
 
-    num_t d = (num_t)(p_candidate - 1);
-    num_t r = 0;
+    // Decompose n + 1 = 2^s*d, with d odd (n + 1 can't overflow, as n is odd)
+    num_t d = (num_t)(n + 1), s = 0;
     while (d % 2 == 0) {
-        r++;
+        s++;
         d /= 2;
     }
 
-    for (size_t i = 0; i < ARRAY_SIZE(rm_witnesses); i++) {
-        if (!test_rm_witness(p_candidate, d, r, rm_witnesses[i])) {
+    // Compute U_d, V_d and Q^d with the binary method, starting from U_1, V_1 and Q^1
+    num_t top_bit = 1;
+    while (d / top_bit > 1) {
+        top_bit = (num_t)(top_bit * 2);
+    }
+    num_t u = mont->one, v = mont->one, q_k = mont_q;
+    for (num_t bit = (num_t)(top_bit / 2); bit != 0; bit /= 2) {
+        // U_2k = U_k*V_k, V_2k = V_k^2 - 2*Q^k
+        u = montgomery_mul(mont, u, v);
+        v = sub_mod(montgomery_mul(mont, v, v), add_mod(q_k, q_k, n), n);
+        q_k = montgomery_mul(mont, q_k, q_k);
+        if ((d & bit) != 0) {
+            // U_k+1 = (P*U_k + V_k)/2, V_k+1 = (D*U_k + P*V_k)/2
+            num_t next_u = half_mod(add_mod(u, v, n), n);
+            v = half_mod(add_mod(montgomery_mul(mont, mont_d, u), v, n), n);
+            u = next_u;
+            q_k = montgomery_mul(mont, q_k, mont_q);
+        }
+    }
+
+    if (u == 0 || v == 0) {
+        return true;
+    }
+    for (num_t r = 1; r < s; r++) {
+        v = sub_mod(montgomery_mul(mont, v, v), add_mod(q_k, q_k, n), n);
+        q_k = montgomery_mul(mont, q_k, q_k);
+        if (v == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Checks if a given number is a prime number (true) or not (false)
+/// using the Baillie-PSW primality test, which is known to be deterministic
+/// for all 64-bit unsigned integer inputs
+/// See: https://en.wikipedia.org/wiki/Baillie%E2%80%93PSW_primality_test
+static bool bpsw_primality_test(num_t p_candidate) {
+    bool is_prime;
+    if (trivial_primality_test(p_candidate, &is_prime)) {
+        return is_prime;
+    }
+    for (size_t i = 1; i < ARRAY_SIZE(rm_witnesses); i++) {
+        if (p_candidate % rm_witnesses[i] == 0) {
             return false;
         }
     }
 
-    return true;
+    struct rm_candidate candidate = init_rm_candidate(p_candidate);
+    return test_rm_witness(&candidate, 2) &&
+           !is_perfect_square(p_candidate) &&
+           strong_lucas_test(&candidate.mont);
+}
+
+/// Checks if a given number is a prime number (true) or not (false)
+/// using the specified primality engine
+static bool primality_test(enum primality_engine primality, num_t p_candidate) {
+    STATS_ADD(primality_tests, 1);
+    switch (primality) {
+    case PRIMALITY_MINIMAL:
+        return rm_minimal_primality_test(p_candidate);
+    case PRIMALITY_BPSW:
+        return bpsw_primality_test(p_candidate);
+    case PRIMALITY_REFERENCE:
+    default:
+        return rm_primality_test(p_candidate);
+    }
 }
 
 /*********************************************************************************
@@ -198,95 +769,3492 @@ static bool rm_primality_test(num_t p_candidate) {
 /// Checks if a given integer is a Sophie-Germain safe prime (aka. q)
 /// Sophie-Germain prime condition (p where q=p*2+1)
 /// See: https://en.wikipedia.org/wiki/Sophie_Germain_prime#Pseudorandom_number_generation
-static bool is_sophie_germain_safe_prime(num_t q_candidate) {
+static bool is_sophie_germain_safe_prime(num_t q_candidate, enum primality_engine primality) {
     num_t p_candidate = (num_t)((q_candidate - 1) / 2);
     // Associated maximally periodic reciprocal condition for p
     num_t max_recip_test = p_candidate % 20;
 
-    return (max_recip_test == 3 || max_recip_test == 9 || max_recip_test == 11) &&
-           rm_primality_test(q_candidate) &&
-           rm_primality_test(p_candidate);
+    if (max_recip_test != 3 && max_recip_test != 9 && max_recip_test != 11) {
+        STATS_ADD(filter_rejections, 1);
+        return false;
+    }
+    if (!primality_test(primality, q_candidate)) {
+        STATS_ADD(q_rejections, 1);
+        return false;
+    }
+    if (!primality_test(primality, p_candidate)) {
+        STATS_ADD(p_rejections, 1);
+        return false;
+    }
+    STATS_ADD(safe_primes, 1);
+    return true;
 }
 
-/// Generate a Sophie-Germain safe prime greater or equal than the given
+/// Primes whose multiples (as q or p) are skipped by the wheel of the safe prime search
+static const uint32_t wheel_primes[] = { 3, 5, 7 };
+
+/// Modulus of the wheel, which is lcm(40, 3*5*7). The candidates are only
+/// admissible when they are in one of the residue classes mod 40 allowed by the
+/// maximally periodic reciprocal condition (p mod 20 in {3, 9, 11}), and neither q
+/// nor p are multiples of the wheel primes
+#define WHEEL_MODULUS 840
+
+/// Admissible residues modulo WHEEL_MODULUS, and the distance from each of them
+/// to the next one (cyclically), filled the first time a safe prime is searched
+static uint32_t wheel_residues[WHEEL_MODULUS];
+static uint32_t wheel_gaps[WHEEL_MODULUS];
+static size_t num_wheel_residues;
+
+/// Odd primes less than SIEVE_PRIME_LIMIT (excluding the wheel primes),
+/// filled the first time a safe prime is searched
+static uint32_t sieve_primes[SIEVE_PRIME_LIMIT / 2];
+static size_t num_sieve_primes;
+
+static pthread_once_t safe_prime_search_once = PTHREAD_ONCE_INIT;
+
+/// Fills the wheel and the list of primes used to sieve the candidates
+/// (using the sieve of Eratosthenes)
+/// See: https://en.wikipedia.org/wiki/Wheel_factorization
+/// See: https://en.wikipedia.org/wiki/Sieve_of_Eratosthenes
+static void init_safe_prime_search(void) {
+    for (uint32_t q = 0; q < WHEEL_MODULUS; q++) {
+        uint32_t max_recip_test = ((q + WHEEL_MODULUS - 1) / 2) % 20;
+        bool admissible = q % 2 == 1 &&
+            (max_recip_test == 3 || max_recip_test == 9 || max_recip_test == 11);
+        for (size_t i = 0; i < ARRAY_SIZE(wheel_primes); i++) {
+            // q = 1 (mod prime) is p = 0 (mod prime) for an odd q
+            admissible = admissible && q % wheel_primes[i] != 0 && q % wheel_primes[i] != 1;
+        }
+        if (admissible) {
+            wheel_residues[num_wheel_residues++] = q;
+        }
+    }
+    for (size_t i = 0; i < num_wheel_residues; i++) {
+        wheel_gaps[i] = i + 1 < num_wheel_residues ?
+            wheel_residues[i + 1] - wheel_residues[i] :
+            WHEEL_MODULUS - wheel_residues[i] + wheel_residues[0];
+    }
+
+    static bool composite[SIEVE_PRIME_LIMIT];
+    for (uint32_t i = 3; i < SIEVE_PRIME_LIMIT; i += 2) {
+        if (!composite[i]) {
+            if (i > wheel_primes[ARRAY_SIZE(wheel_primes) - 1]) {
+                sieve_primes[num_sieve_primes++] = i;
+            }
+            for (uint32_t j = i * i; j < SIEVE_PRIME_LIMIT; j += 2 * i) {
+                composite[j] = true;
+            }
+        }
+    }
+}
+
+/// Marks the candidates of the sieve window which are multiples of the given prime,
+/// starting from the given offset, and returns the offset for the next window
+static uint32_t mark_sieve_multiples(bool *composite, size_t window_size,
+                                     uint32_t prime, uint32_t offset) {
+    size_t j = offset;
+    for (; j < window_size; j += prime) {
+        composite[j] = true;
+    }
+    return (uint32_t)(j - window_size);
+}
+
+/// Returns the distance from an integer with the given residue (mod WHEEL_MODULUS) to the
+/// first admissible candidate of the wheel from it, and stores the index of its residue
+static uint32_t wheel_first_gap(uint32_t residue, size_t *wheel_index) {
+    size_t index = 0;
+    while (index < num_wheel_residues && wheel_residues[index] < residue) {
+        index++;
+    }
+    uint32_t gap = index < num_wheel_residues ?
+        wheel_residues[index] - residue :
+        WHEEL_MODULUS - residue + wheel_residues[0];
+    *wheel_index = index % num_wheel_residues;
+    return gap;
+}
+
+/// Search of consecutive Sophie-Germain safe primes from a lower bound. Between the safe
+/// primes which it returns, it keeps the position in the wheel and the sieve window of the
+/// candidates, so that a whole range is sieved in a single pass (see next_safe_prime)
+struct safe_prime_search {
+    /// Next candidate, which is below WHEEL_MODULUS while they are tested one by one
+    num_t q_candidate;
+    size_t wheel_index;
+    /// Whether the candidates are in the wheel (and the offsets are set), and whether
+    /// there are no candidates left below NUM_MAX
+    bool sieving;
+    bool exhausted;
+    /// Sieve window, whose size is 0 before the first one is sieved
+    num_t window_start;
+    size_t window_size;
+    /// Offset of the next candidate in the window where q = 0 (mod prime),
+    /// and where q = 1 (mod prime), that is, p = 0 (mod prime) for an odd q
+    uint32_t q_offsets[ARRAY_SIZE(sieve_primes)], p_offsets[ARRAY_SIZE(sieve_primes)];
+    bool composite[SIEVE_WINDOW_SIZE];
+};
+
+/// Starts a search of the Sophie-Germain safe primes greater or equal than the given
 /// (inclusive) lower bound
+static void start_safe_prime_search(struct safe_prime_search *search, num_t lower_bound) {
+    pthread_once(&safe_prime_search_once, init_safe_prime_search);
+    search->q_candidate = lower_bound;
+    search->wheel_index = 0;
+    search->sieving = false;
+    search->exhausted = false;
+    search->window_start = 0;
+    search->window_size = 0;
+}
+
+/// Returns the next Sophie-Germain safe prime of the search, or 0 if there is none below NUM_MAX.
+/// The search only visits the candidates in the admissible residue classes of the wheel,
+/// which are sieved in windows with a segmented sieve before being tested. This rejects
+/// any candidate where either q or p = (q-1)/2 have a small prime factor, so most
+/// candidates are rejected without needing any Rabin-Miller test
 /// See: https://en.wikipedia.org/wiki/Sophie_Germain_prime#Pseudorandom_number_generation
-static num_t generate_sophie_germain_safe_prime(num_t lower_bound) {
-    for (num_t q_candidate = lower_bound; q_candidate != NUM_MAX; q_candidate++) {
-        if (is_sophie_germain_safe_prime(q_candidate)) {
+/// See: https://en.wikipedia.org/wiki/Sieve_of_Eratosthenes#Segmented_sieve
+static num_t next_safe_prime(struct safe_prime_search *search, enum primality_engine primality) {
+    // The wheel would also skip the wheel primes themselves (as q or p),
+    // so the candidates where this could happen are tested one by one
+    while (!search->sieving && search->q_candidate < WHEEL_MODULUS) {
+        num_t q_candidate = search->q_candidate++;
+        STATS_ADD(candidates, 1);
+        if (is_sophie_germain_safe_prime(q_candidate, primality)) {
             return q_candidate;
         }
     }
 
-    return 0; // Not possible to find safe prime in acceptable range
+    // Find the first admissible candidate
+    if (!search->sieving) {
+        uint32_t first_gap = wheel_first_gap((uint32_t)(search->q_candidate % WHEEL_MODULUS),
+                                             &search->wheel_index);
+        search->sieving = true;
+        search->exhausted = (num_t)(NUM_MAX - search->q_candidate) <= first_gap;
+        search->q_candidate = (num_t)(search->q_candidate + first_gap);
+        search->window_start = search->q_candidate;
+        for (size_t i = 0; i < num_sieve_primes && !search->exhausted; i++) {
+            uint32_t prime = sieve_primes[i];
+            search->q_offsets[i] = (prime - (uint32_t)(search->q_candidate % prime)) % prime;
+            search->p_offsets[i] = (search->q_offsets[i] + 1) % prime;
+        }
+    }
+
+    while (!search->exhausted) {
+        if ((size_t)(search->q_candidate - search->window_start) >= search->window_size) {
+            search->window_start = (num_t)(search->window_start + search->window_size);
+            search->window_size = SIEVE_WINDOW_SIZE;
+            if ((num_t)(NUM_MAX - search->window_start) < search->window_size) {
+                search->window_size = (size_t)(NUM_MAX - search->window_start);
+            }
+
+            memset(search->composite, 0, search->window_size);
+            for (size_t i = 0; i < num_sieve_primes; i++) {
+                search->q_offsets[i] = mark_sieve_multiples(search->composite, search->window_size,
+                                                            sieve_primes[i], search->q_offsets[i]);
+                search->p_offsets[i] = mark_sieve_multiples(search->composite, search->window_size,
+                                                            sieve_primes[i], search->p_offsets[i]);
+            }
+        }
+
+        // The sieve would also reject the small primes themselves (as q or p),
+        // so the candidates where this could happen are always tested
+        num_t q_candidate = search->q_candidate;
+        bool sieved = q_candidate > 2 * SIEVE_PRIME_LIMIT + 1 &&
+                      search->composite[q_candidate - search->window_start];
+        STATS_ADD(candidates, 1);
+        STATS_ADD(sieve_rejections, sieved);
+
+        // Move to the next candidate before testing this one, so the search continues after it
+        uint32_t gap = wheel_gaps[search->wheel_index];
+        search->wheel_index = (search->wheel_index + 1) % num_wheel_residues;
+        search->exhausted = (num_t)(NUM_MAX - q_candidate) <= gap; // No more safe primes in range
+        search->q_candidate = (num_t)(q_candidate + gap);
+        if (!sieved && is_sophie_germain_safe_prime(q_candidate, primality)) {
+            return q_candidate;
+        }
+    }
+    return 0;
 }
 
-/// Generates an uniform sample, using a pseudorandom number generator
-/// based on Sophie-Germain safe primes
-static void generate_uniform_sophie(num_t num_observations, num_t seed) {
-    // Generate the required Sophie-Germain safe prime. If the program is correctly
-    // configured, this generates a different value of q for every seed,
-    // and it is greater than NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION + 1,
-    // so it will generate (at least) NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION digits
-    num_t min_q = (num_t)(NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION + 1 + seed * NUM_PRIME_GERMAIN_GAP_MAX);
-    fprintf(stderr, "Looking for a Sophie-Germain safe prime q >= %" PRInum "\n", min_q);
+/// Generate a Sophie-Germain safe prime greater or equal than the given
+/// (inclusive) lower bound (see next_safe_prime), or 0 if there is none below NUM_MAX
+static num_t generate_sophie_germain_safe_prime(num_t lower_bound, enum primality_engine primality) {
+    struct safe_prime_search search;
+    start_safe_prime_search(&search, lower_bound);
+    return next_safe_prime(&search, primality);
+}
 
-    num_t found_q = generate_sophie_germain_safe_prime(min_q);
-    fprintf(stderr, "Found a Sophie-Germain safe prime q = %" PRInum "\n", found_q);
-    assert(found_q != 0 && found_q <= min_q + NUM_PRIME_GERMAIN_GAP_MAX &&
-        "Invalid configuration: Numeric overflow and/or incorrect NUM_PRIME_GERMAIN_GAP_MAX.");
+/// Returns the lower bound of the Sophie-Germain safe prime for the given seed.
+/// If the program is correctly configured, the safe prime is different for every seed,
+/// and it is greater than NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION + 1,
+/// so it will generate (at least) NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION digits
+static num_t seed_min_q(num_t seed) {
+    return (num_t)(NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION + 1 + seed * NUM_PRIME_GERMAIN_GAP_MAX);
+}
 
-    // Generate the decimal expansion of 1/q, that is, our random digits,
-    // using a simple long-division based decimal digit extraction algorithm
-    fprintf(stderr, "Generating the decimal expansion of 1/%" PRInum "...\n", found_q);
+/// Checks whether the Sophie-Germain safe prime found for the given seed is valid, that is,
+/// it is within NUM_PRIME_GERMAIN_GAP_MAX of its lower bound, so it isn't the one of another seed
+static bool valid_seed_q(num_t seed, num_t found_q) {
+    return found_q != 0 && found_q <= seed_min_q(seed) + NUM_PRIME_GERMAIN_GAP_MAX;
+}
 
-    num_t r = 1;
-    char observation[NUM_DIGITS_PER_OBSERVATION+3];
-    sprintf(observation, "0.%0" VALUE_STRINGIFY(NUM_DIGITS_PER_OBSERVATION) PRInum, (num_t)0);
+/// Computes the remainder of the long division of 1/q right before the digits
+/// of the given observation are extracted, that is, 10**(observation*digits) mod q.
+/// This allows starting the generator at any observation in O(log n) time,
+/// without extracting all the digits of the preceding observations
+static num_t jump_ahead_remainder(num_t found_q, num_t observation) {
+    return pow10_observations_mod(found_q, observation);
+}
 
-    for (num_t i = 0; i < num_observations; i++) {
-        for (size_t j = 0; j < NUM_DIGITS_PER_OBSERVATION; j++) {
-            observation[j+2] = (char)('0' + ((r * 10) / found_q));
-            r = (num_t)((r * 10) % found_q);
+/// Searches the Sophie-Germain safe primes of num_seeds consecutive seeds, starting from
+/// first_seed, into qs. The search of every seed starts at its lower bound, unless the safe
+/// prime of the previous seed is already beyond it. Note that sweeping the whole range in a
+/// single pass would test many more candidates, since the safe prime of a seed is usually
+/// found long before the lower bound of the next seed
+static void search_seed_range(num_t first_seed, size_t num_seeds, num_t *qs,
+                              enum primality_engine primality) {
+    num_t q = 0;
+    for (size_t i = 0; i < num_seeds; i++) {
+        num_t min_q = seed_min_q((num_t)(first_seed + i));
+        if (q < min_q) {
+            q = generate_sophie_germain_safe_prime(min_q, primality);
         }
-        puts(observation);
+        qs[i] = q;
     }
 }
 
-/// Entry point of the application. Parses the command line inputs and calls the generator
-int main(int argc, char *argv[]) {
-    // Do some basic sanity checks on the configuration
-    assert(sizeof(num_t) * 2 <= sizeof(bignum_t) && "Invalid configuration: bignum_t misconfigured");
+/// Worker thread of the parallel search of the safe primes of many seeds. Its range of seeds
+/// (relative to the first one) is packed as (end << 32) | start, so that the worker can take
+/// seeds from its start while other workers steal from its end, with atomic operations
+struct seed_search_worker {
+    uint64_t range __attribute__((aligned(CACHE_LINE_SIZE)));
+    pthread_t thread;
+    struct seed_search *search;
+};
 
-    assert((SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX) / NUM_PRIME_GERMAIN_GAP_MAX == SEED_MAX &&
-        "Invalid configuration: (SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX) overflows.");
+/// Parallel search of the safe primes of many seeds, shared by all the workers
+struct seed_search {
+    num_t first_seed;
+    num_t *qs;
+    enum primality_engine primality;
+    struct seed_search_worker *workers;
+    size_t num_workers;
+};
 
-    assert((SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX) / NUM_PRIME_GERMAIN_GAP_MAX == SEED_MAX &&
-        "Invalid configuration: (SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX) overflows.");
+/// Takes up to SEARCH_CHUNK_SEEDS seeds from the start of the range of a worker.
+/// Returns false if the range is empty
+static bool take_seeds(uint64_t *range, uint32_t *start, uint32_t *count) {
+    uint64_t old_range = __atomic_load_n(range, __ATOMIC_ACQUIRE);
+    for (;;) {
+        uint32_t old_start = (uint32_t)old_range, end = (uint32_t)(old_range >> 32);
+        if (old_start >= end) {
+            return false;
+        }
+        uint32_t taken = end - old_start < SEARCH_CHUNK_SEEDS ? end - old_start : SEARCH_CHUNK_SEEDS;
+        uint64_t new_range = ((uint64_t)end << 32) | (old_start + taken);
+        if (__atomic_compare_exchange_n(range, &old_range, new_range, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *start = old_start;
+            *count = taken;
+            return true;
+        }
+    }
+}
 
-    assert((NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION) / NUM_DIGITS_PER_OBSERVATION == NUM_OBSERVATIONS_MAX &&
-        "Invalid configuration: (NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION) overflows.");
+/// Steals the second half of the largest range of the other workers into the (empty) range
+/// of the given worker. Returns false if there is nothing left to steal
+static bool steal_seeds(struct seed_search *search, struct seed_search_worker *thief) {
+    for (;;) {
+        struct seed_search_worker *victim = NULL;
+        uint64_t victim_range = 0;
+        uint32_t victim_size = 0;
+        for (size_t i = 0; i < search->num_workers; i++) {
+            uint64_t range = __atomic_load_n(&search->workers[i].range, __ATOMIC_ACQUIRE);
+            uint32_t start = (uint32_t)range, end = (uint32_t)(range >> 32);
+            if (start < end && end - start > victim_size) {
+                victim = &search->workers[i];
+                victim_range = range;
+                victim_size = end - start;
+            }
+        }
+        if (victim == NULL) {
+            return false;
+        }
 
-    assert(SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX + NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION+ 1 >
-           SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX && "Invalid configuration: "
-           "(SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX + NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION + 1) overflows.");
+        uint32_t start = (uint32_t)victim_range, end = (uint32_t)(victim_range >> 32);
+        uint32_t middle = start + victim_size / 2;
+        uint64_t new_victim_range = ((uint64_t)middle << 32) | start;
+        if (__atomic_compare_exchange_n(&victim->range, &victim_range, new_victim_range, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&thief->range, ((uint64_t)end << 32) | middle, __ATOMIC_RELEASE);
+            return true;
+        }
+    }
+}
 
-    // Print title, check and validate command line arguments
-    fprintf(stderr, "PRNG Based on Sophie-Germain primes\n");
-    fprintf(stderr, "-----------------------------------\n");
+/// Entry point of a worker thread of the parallel search of the safe primes of many seeds
+static void *run_seed_search_worker(void *worker_ptr) {
+    struct seed_search_worker *worker = worker_ptr;
+    struct seed_search *search = worker->search;
+    uint32_t start, count;
+    do {
+        while (take_seeds(&worker->range, &start, &count)) {
+            search_seed_range((num_t)(search->first_seed + start), count,
+                              &search->qs[start], search->primality);
+        }
+    } while (steal_seeds(search, worker));
+    return NULL;
+}
 
-    num_t num_observations, seed;
-    if (argc != 3 ||
-        !parse_num(argv[1], &num_observations) || num_observations > NUM_OBSERVATIONS_MAX ||
-        !parse_num(argv[2], &seed) || seed > SEED_MAX)
-    {
-        fprintf(stderr, "Usage: %s num_observations seed\n", argv[0]);
-        fprintf(stderr, "    (where num_observations <= %" PRInum ")\n", NUM_OBSERVATIONS_MAX);
-        fprintf(stderr, "    (where seed <= %" PRInum ")\n", SEED_MAX);
-        return EXIT_FAILURE;
+/// Searches the Sophie-Germain safe primes of num_seeds consecutive seeds, starting
+/// from first_seed, into qs, using the given number of threads. The seeds are split
+/// evenly between the threads, which search them in chunks in a single sieve pass, and
+/// steal seeds from the others when they finish theirs. Returns false on failure
+static bool search_seeds(num_t first_seed, size_t num_seeds, num_t *qs,
+                         enum primality_engine primality, size_t num_threads) {
+    struct seed_search search = { first_seed, qs, primality, NULL, num_threads };
+    if (num_seeds > UINT32_MAX ||
+        posix_memalign((void **)&search.workers, CACHE_LINE_SIZE, num_threads * sizeof(*search.workers)) != 0) {
+        fprintf(stderr, "Out of memory allocating the search of %zu seeds\n", num_seeds);
+        return false;
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        uint64_t start = num_seeds * i / num_threads, end = num_seeds * (i + 1) / num_threads;
+        search.workers[i].range = (end << 32) | start;
+        search.workers[i].search = &search;
     }
 
-    // Once we have a valid parametrization, run the core algorithm
-    generate_uniform_sophie(num_observations, seed);
-    return EXIT_SUCCESS;
-}
+    // This thread is a worker too, so the seeds are searched even if no thread could be created
+    size_t num_started = 1;
+    for (; num_started < num_threads; num_started++) {
+        if (pthread_create(&search.workers[num_started].thread, NULL, run_seed_search_worker,
+                           &search.workers[num_started]) != 0) {
+            break;
+        }
+    }
+    run_seed_search_worker(&search.workers[0]);
+    for (size_t i = 1; i < num_started; i++) {
+        pthread_join(search.workers[i].thread, NULL);
+    }
+    free(search.workers);
+    return true;
+}
+
+/// Extracts an observation of the decimal expansion of 1/q from the given remainder
+/// as an integer of NUM_DIGITS_PER_OBSERVATION digits (a "chunk"), through a single
+/// division of r*10**NUM_DIGITS_PER_OBSERVATION (which can't overflow since r < q)
+/// by the precomputed reciprocal of q. Stores the remainder after the last digit into *r
+static num_t extract_observation_chunk_reciprocal(const struct reciprocal *reciprocal, num_t *r) {
+    return divide_reciprocal(reciprocal, (bignum_t)*r * POW10_DIGITS_PER_OBSERVATION, r);
+}
+
+/// Converts an observation chunk into the double nearest to its value, that is,
+/// chunk / 10**NUM_DIGITS_PER_OBSERVATION (the same as parsing its text line).
+/// This is done with integer arithmetic, so it is correctly rounded even if
+/// the floating point division is not (e.g. with -Ofast, which multiplies by the inverse)
+static double observation_chunk_to_double(num_t chunk) {
+    if (chunk == 0) {
+        return 0.0;
+    }
+
+    // Scale the chunk by 2**shift so the quotient of the division has 54 bits: 53 for the
+    // mantissa and one more for the rounding (plus the remainder as the sticky bit)
+    unsigned __int128 divisor = POW10_DIGITS_PER_OBSERVATION;
+    int shift = 53 + (64 - __builtin_clzll((uint64_t)divisor)) - (64 - __builtin_clzll((uint64_t)chunk));
+    unsigned __int128 dividend = (unsigned __int128)chunk << shift;
+    if (dividend < (divisor << 53)) {
+        dividend <<= 1;
+        shift++;
+    }
+    uint64_t quotient = (uint64_t)(dividend / divisor);
+    bool sticky = dividend % divisor != 0;
+
+    // Round to nearest, ties to even
+    uint64_t mantissa = quotient >> 1;
+    if ((quotient & 1) != 0 && (sticky || (mantissa & 1) != 0)) {
+        mantissa++;
+    }
+    int exponent = 52 - (shift - 1);
+    if (mantissa == (UINT64_C(1) << 53)) {
+        mantissa >>= 1;
+        exponent++;
+    }
+
+    uint64_t bits = ((uint64_t)(1023 + exponent) << 52) | (mantissa & ((UINT64_C(1) << 52) - 1));
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/***********************************************
+ * MULTI-STREAM DIGIT EXTRACTION IN VECTOR LANES *
+ ***********************************************/
+
+/// Number of vectors which are advanced at once, so their dependency chains are interleaved.
+/// The generators which are advanced at once in the lanes of the kernel are LANE_VECTORS
+/// times the number of doubles of every vector, up to STREAM_LANES_MAX
+#define LANE_VECTORS 4
+#define STREAM_LANES_MAX (LANE_VECTORS * 64 / sizeof(double))
+
+/// Returns whether the multi-stream kernel can generate the decimal expansion of 1/q,
+/// that is, whether r * 10**STREAM_DIGITS_PER_STEP is exact as a double for all r < q
+static bool lane_supports_q(uint64_t q) {
+    return q <= ((UINT64_C(1) << 53) - 1) / POW10_STREAM_DIGITS_PER_STEP;
+}
+
+/// Defines the multi-stream kernel for vectors of num_bytes bytes, compiled with the given
+/// function attributes (e.g. the target instruction set), with names suffixed by the suffix.
+/// The vectors are GCC vector extensions, which are lowered to the SIMD instructions of the
+/// target, so num_bytes is the size of its registers, since GCC splits wider vectors into
+/// scalar comparisons:
+/// - lane_double_t: Vectors of doubles (and lane_mask_t, lane_int32_t of the same lanes)
+/// - struct lane_expansions: Decimal expansions of 1/q for LANE_VECTORS vectors of values of q,
+///   which are advanced in lockstep (lane i is the element i % lanes of the vector i / lanes).
+///   All the values except inverse_q are integers, which are exact as doubles. inverse_q is 1/q,
+///   rounded down by slightly more than the rounding errors of the kernel, and r the remainders
+/// - extract_lane_observations(lanes, chunks): Extracts the next observation of the expansion
+///   of every lane as a chunk (as an exact double) into chunks, and advances their remainders.
+///   Every long division step multiplies by an inverse of q rounded down, so the quotient is
+///   never too high and at most one too low, and then corrects it, without any integer division
+/// - fill_lanes(states, lane_states, num_lanes, bufs, n, as_double): Fills the buffers of the
+///   given generator states (up to the lanes of the kernel, all supported by lane_supports_q)
+///   with their next n observations, as fill_streams does
+#define DEFINE_LANE_KERNEL(suffix, num_bytes, attributes) \
+typedef double lane_double_##suffix##_t __attribute__((vector_size(num_bytes))); \
+typedef int64_t lane_mask_##suffix##_t __attribute__((vector_size(num_bytes))); \
+typedef int32_t lane_int32_##suffix##_t __attribute__((vector_size((num_bytes) / 2))); \
+\
+struct lane_expansions_##suffix { \
+    lane_double_##suffix##_t q[LANE_VECTORS]; \
+    lane_double_##suffix##_t inverse_q[LANE_VECTORS]; \
+    lane_double_##suffix##_t r[LANE_VECTORS]; \
+}; \
+\
+attributes static void extract_lane_observations_##suffix(struct lane_expansions_##suffix *lanes, \
+                                                          lane_double_##suffix##_t *chunks) { \
+    const lane_double_##suffix##_t zero = { 0 }, one = zero + 1.0; \
+    for (size_t v = 0; v < LANE_VECTORS; v++) { \
+        lane_double_##suffix##_t q = lanes->q[v], r = lanes->r[v], chunk = zero; \
+        for (size_t step = 0; step < NUM_DIGITS_PER_OBSERVATION / STREAM_DIGITS_PER_STEP; step++) { \
+            lane_double_##suffix##_t dividend = r * (double)POW10_STREAM_DIGITS_PER_STEP; \
+            /* Truncating through 32-bit integers, which have a vector conversion on all targets */ \
+            lane_double_##suffix##_t quotient = __builtin_convertvector(__builtin_convertvector( \
+                dividend * lanes->inverse_q[v], lane_int32_##suffix##_t), lane_double_##suffix##_t); \
+            r = dividend - quotient * q; \
+\
+            lane_mask_##suffix##_t too_low = r >= q; \
+            r -= (lane_double_##suffix##_t)((lane_mask_##suffix##_t)q & too_low); \
+            quotient += (lane_double_##suffix##_t)((lane_mask_##suffix##_t)one & too_low); \
+\
+            chunk = chunk * (double)POW10_STREAM_DIGITS_PER_STEP + quotient; \
+        } \
+        lanes->r[v] = r; \
+        chunks[v] = chunk; \
+    } \
+} \
+\
+attributes static void fill_lanes_##suffix(struct sophie_state *states, const size_t *lane_states, \
+                                           size_t num_lanes, void *const *bufs, size_t n, \
+                                           bool as_double) { \
+    const size_t vector_lanes = (num_bytes) / sizeof(double); \
+    /* The unused lanes repeat the expansion of the first one, and their output is discarded */ \
+    struct lane_expansions_##suffix lanes; \
+    for (size_t lane = 0; lane < LANE_VECTORS * vector_lanes; lane++) { \
+        const struct sophie_state *state = &states[lane_states[lane < num_lanes ? lane : 0]]; \
+        lanes.q[lane / vector_lanes][lane % vector_lanes] = (double)state->q; \
+        lanes.inverse_q[lane / vector_lanes][lane % vector_lanes] = \
+            (1.0 / (double)state->q) * (1.0 - 0x1p-50); \
+        lanes.r[lane / vector_lanes][lane % vector_lanes] = (double)state->r; \
+    } \
+\
+    /* Generate the observations in blocks, which are then stored contiguously for every lane */ \
+    for (size_t start = 0; start < n; start += STREAM_BLOCK_OBSERVATIONS) { \
+        lane_double_##suffix##_t chunks[STREAM_BLOCK_OBSERVATIONS][LANE_VECTORS]; \
+        size_t block_size = n - start < STREAM_BLOCK_OBSERVATIONS ? n - start : STREAM_BLOCK_OBSERVATIONS; \
+        for (size_t i = 0; i < block_size; i++) { \
+            extract_lane_observations_##suffix(&lanes, chunks[i]); \
+        } \
+\
+        for (size_t lane = 0; lane < num_lanes; lane++) { \
+            size_t v = lane / vector_lanes, element = lane % vector_lanes; \
+            if (as_double) { \
+                double *dest = (double *)bufs[lane_states[lane]] + start; \
+                for (size_t i = 0; i < block_size; i++) { \
+                    dest[i] = observation_chunk_to_double((num_t)(int64_t)chunks[i][v][element]); \
+                } \
+            } else { \
+                uint64_t *dest = (uint64_t *)bufs[lane_states[lane]] + start; \
+                for (size_t i = 0; i < block_size; i++) { \
+                    dest[i] = (num_t)(int64_t)chunks[i][v][element]; \
+                } \
+            } \
+        } \
+    } \
+\
+    for (size_t lane = 0; lane < num_lanes; lane++) { \
+        struct sophie_state *state = &states[lane_states[lane]]; \
+        state->r = (uint64_t)(int64_t)lanes.r[lane / vector_lanes][lane % vector_lanes]; \
+        state->position += n; \
+    } \
+}
+
+/// Variant of the multi-stream kernel for an instruction set, which is picked at runtime
+/// as the widest one supported by the CPU, so the same binary uses the widest vectors
+/// of every CPU without requiring them (as compiling everything with -march would)
+struct lane_kernel {
+    const char *name;
+    /// Number of generators which are advanced at once
+    size_t lanes;
+    void (*fill_lanes)(struct sophie_state *states, const size_t *lane_states, size_t num_lanes,
+                       void *const *bufs, size_t n, bool as_double);
+    /// Returns whether the running CPU supports the kernel
+    bool (*supported)(void);
+};
+
+/// Returns true, for the kernels which the target of the build always supports
+static bool lane_kernel_always_supported(void) {
+    return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+DEFINE_LANE_KERNEL(sse2, 16, )
+DEFINE_LANE_KERNEL(avx2, 32, __attribute__((target("avx2"))))
+DEFINE_LANE_KERNEL(avx512, 64, __attribute__((target("avx512f"))))
+
+/// Returns whether the running CPU (and the operating system) supports AVX2 and AVX-512
+static bool lane_kernel_avx2_supported(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static bool lane_kernel_avx512_supported(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+/// Variants of the multi-stream kernel, from the widest to the narrowest one (baseline).
+/// It is the only code which has variants selected at runtime, since the builds of the scalar
+/// paths (e.g. the Montgomery multiplication with BMI2) for newer targets showed no gains
+/// (see the isa/ benchmarks of sophie-bench)
+static const struct lane_kernel lane_kernels[] = {
+    { "avx512", LANE_VECTORS * 64 / sizeof(double), fill_lanes_avx512, lane_kernel_avx512_supported },
+    { "avx2", LANE_VECTORS * 32 / sizeof(double), fill_lanes_avx2, lane_kernel_avx2_supported },
+    { "sse2", LANE_VECTORS * 16 / sizeof(double), fill_lanes_sse2, lane_kernel_always_supported },
+};
+#else
+DEFINE_LANE_KERNEL(generic, 16, )
+
+/// Variants of the multi-stream kernel: On the other targets (NEON, ...) only the baseline one
+static const struct lane_kernel lane_kernels[] = {
+    { "generic", LANE_VECTORS * 16 / sizeof(double), fill_lanes_generic, lane_kernel_always_supported },
+};
+#endif
+
+static const struct lane_kernel *selected_lane_kernel;
+static pthread_once_t lane_kernel_once = PTHREAD_ONCE_INIT;
+
+/// Selects the widest variant of the multi-stream kernel which the CPU supports
+static void select_lane_kernel(void) {
+    size_t i = 0;
+    while (i + 1 < ARRAY_SIZE(lane_kernels) && !lane_kernels[i].supported()) {
+        i++;
+    }
+    selected_lane_kernel = &lane_kernels[i];
+}
+
+/// Returns the variant of the multi-stream kernel for the CPU, selecting it the first time
+static const struct lane_kernel *lane_kernel(void) {
+    pthread_once(&lane_kernel_once, select_lane_kernel);
+    return selected_lane_kernel;
+}
+
+/// Does some basic sanity checks on the configuration
+static void check_configuration(void) {
+    assert(sizeof(num_t) * 2 <= sizeof(bignum_t) && "Invalid configuration: bignum_t misconfigured");
+
+    assert((SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX) / NUM_PRIME_GERMAIN_GAP_MAX == SEED_MAX &&
+        "Invalid configuration: (SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX) overflows.");
+
+    assert((SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX) / NUM_PRIME_GERMAIN_GAP_MAX == SEED_MAX &&
+        "Invalid configuration: (SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX) overflows.");
+
+    assert((NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION) / NUM_DIGITS_PER_OBSERVATION == NUM_OBSERVATIONS_MAX &&
+        "Invalid configuration: (NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION) overflows.");
+
+    assert(POW10_DIGITS_PER_OBSERVATION / 10 < POW10_DIGITS_PER_OBSERVATION &&
+           ((bignum_t)NUM_MAX * POW10_DIGITS_PER_OBSERVATION) / POW10_DIGITS_PER_OBSERVATION == NUM_MAX &&
+           "Invalid configuration: (NUM_MAX * POW10_DIGITS_PER_OBSERVATION) overflows.");
+
+    num_t pow10_check = 1;
+    for (size_t i = 0; i < NUM_DIGITS_PER_OBSERVATION; i++) {
+        pow10_check = (num_t)(pow10_check * 10);
+    }
+    assert(pow10_check == POW10_DIGITS_PER_OBSERVATION &&
+        "Invalid configuration: POW10_DIGITS_PER_OBSERVATION != 10**NUM_DIGITS_PER_OBSERVATION.");
+
+    assert(NUM_DIGITS_PER_OBSERVATION % STREAM_DIGITS_PER_STEP == 0 &&
+        "Invalid configuration: STREAM_DIGITS_PER_STEP doesn't divide NUM_DIGITS_PER_OBSERVATION.");
+
+    num_t stream_pow10_check = 1;
+    for (size_t i = 0; i < STREAM_DIGITS_PER_STEP; i++) {
+        stream_pow10_check = (num_t)(stream_pow10_check * 10);
+    }
+    assert(stream_pow10_check == POW10_STREAM_DIGITS_PER_STEP &&
+        "Invalid configuration: POW10_STREAM_DIGITS_PER_STEP != 10**STREAM_DIGITS_PER_STEP.");
+
+    assert(SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX + NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION+ 1 >
+           SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX && "Invalid configuration: "
+           "(SEED_MAX * NUM_PRIME_GERMAIN_GAP_MAX + NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION + 1) overflows.");
+}
+
+/*********************
+ * LIBRARY INTERFACE *
+ *********************/
+
+// See sophie.h for the documentation of the public functions
+
+uint64_t sophie_seed_max(void) {
+    return SEED_MAX;
+}
+
+uint64_t sophie_observations_max(void) {
+    return NUM_OBSERVATIONS_MAX;
+}
+
+/// Initializes the generator state at the first observation for the given safe prime
+/// of the seed. Returns false if the safe prime isn't valid for the seed
+static bool init_state(struct sophie_state *state, num_t seed, num_t found_q) {
+    if (!valid_seed_q(seed, found_q)) {
+        return false;
+    }
+
+    struct reciprocal reciprocal = compute_reciprocal(found_q);
+    state->q = found_q;
+    state->r = 1;
+    state->position = 0;
+    state->reciprocal_divisor = reciprocal.divisor;
+    state->reciprocal_inverse = reciprocal.inverse;
+    state->reciprocal_shift = reciprocal.shift;
+    state->bits = 0;
+    state->num_bits = 0;
+    return true;
+}
+
+bool sophie_init(struct sophie_state *state, uint64_t seed) {
+    check_configuration();
+    if (seed > SEED_MAX) {
+        return false;
+    }
+
+    num_t found_q = generate_sophie_germain_safe_prime(seed_min_q((num_t)seed), PRIMALITY_MINIMAL);
+    return init_state(state, (num_t)seed, found_q);
+}
+
+bool sophie_init_seeds(struct sophie_state *states, uint64_t first_seed, size_t num_seeds,
+                       size_t num_threads) {
+    check_configuration();
+    if (first_seed > SEED_MAX || num_seeds > SEED_MAX - first_seed + 1 || num_threads == 0) {
+        return false;
+    }
+
+    num_t *qs = malloc(num_seeds * sizeof(*qs));
+    bool success = qs != NULL && search_seeds((num_t)first_seed, num_seeds, qs,
+                                              PRIMALITY_MINIMAL, num_threads);
+    for (size_t i = 0; i < num_seeds && success; i++) {
+        success = init_state(&states[i], (num_t)(first_seed + i), qs[i]);
+    }
+    free(qs);
+    return success;
+}
+
+bool sophie_seek(struct sophie_state *state, uint64_t position) {
+    if (position > NUM_OBSERVATIONS_MAX) {
+        return false;
+    }
+    state->r = jump_ahead_remainder((num_t)state->q, (num_t)position);
+    state->position = position;
+    state->bits = 0;
+    state->num_bits = 0;
+    return true;
+}
+
+/// Returns the precomputed reciprocal of q of the given generator state
+static struct reciprocal state_reciprocal(const struct sophie_state *state) {
+    struct reciprocal reciprocal = {
+        (num_t)state->reciprocal_divisor, (num_t)state->reciprocal_inverse, state->reciprocal_shift
+    };
+    return reciprocal;
+}
+
+uint64_t sophie_next_u64(struct sophie_state *state) {
+    struct reciprocal reciprocal = state_reciprocal(state);
+    num_t r = (num_t)state->r;
+    num_t chunk = extract_observation_chunk_reciprocal(&reciprocal, &r);
+    state->r = r;
+    state->position++;
+    return chunk;
+}
+
+double sophie_next_double(struct sophie_state *state) {
+    return observation_chunk_to_double((num_t)sophie_next_u64(state));
+}
+
+void sophie_fill_u64(struct sophie_state *state, uint64_t *buf, size_t n) {
+    // Keep the state in local variables during the loop, since the compiler
+    // can't know that buf doesn't alias it
+    struct reciprocal reciprocal = state_reciprocal(state);
+    num_t r = (num_t)state->r;
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = extract_observation_chunk_reciprocal(&reciprocal, &r);
+    }
+    state->r = r;
+    state->position += n;
+}
+
+void sophie_fill_f64(struct sophie_state *state, double *buf, size_t n) {
+    struct reciprocal reciprocal = state_reciprocal(state);
+    num_t r = (num_t)state->r;
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = observation_chunk_to_double(extract_observation_chunk_reciprocal(&reciprocal, &r));
+    }
+    state->r = r;
+    state->position += n;
+}
+
+bool sophie_index_init(struct sophie_index *index, uint64_t seed, uint64_t block_size) {
+    struct sophie_state state;
+    if (block_size == 0) {
+        block_size = 1;
+        while (block_size * block_size < NUM_OBSERVATIONS_MAX) {
+            block_size *= 2;
+        }
+    }
+    if (block_size > NUM_OBSERVATIONS_MAX || !sophie_init(&state, seed)) {
+        return false;
+    }
+
+    uint64_t num_blocks = (NUM_OBSERVATIONS_MAX - 1) / block_size + 1;
+    uint64_t *remainders = malloc((size_t)(num_blocks + block_size) * sizeof(*remainders));
+    if (remainders == NULL) {
+        return false;
+    }
+
+    // Advance by a whole observation (offsets) and by a whole block (blocks) in Montgomery form
+    struct montgomery mont = init_montgomery((num_t)state.q);
+    num_t pow10 = montgomery_pow(&mont, montgomery_from(&mont, 10), NUM_DIGITS_PER_OBSERVATION);
+    num_t pow10_block = montgomery_pow(&mont, pow10, (num_t)block_size);
+    num_t x = mont.one;
+    for (uint64_t j = 0; j < num_blocks; j++, x = montgomery_mul(&mont, x, pow10_block)) {
+        remainders[j] = x;
+    }
+    x = mont.one;
+    for (uint64_t k = 0; k < block_size; k++, x = montgomery_mul(&mont, x, pow10)) {
+        remainders[num_blocks + k] = montgomery_reduce(&mont, 0, x);
+    }
+
+    index->q = state.q;
+    index->block_size = block_size;
+    index->num_blocks = num_blocks;
+    index->block_remainders = remainders;
+    index->offset_factors = remainders + num_blocks;
+    index->montgomery_inverse = mont.inverse;
+    index->reciprocal_divisor = state.reciprocal_divisor;
+    index->reciprocal_inverse = state.reciprocal_inverse;
+    index->reciprocal_shift = state.reciprocal_shift;
+    return true;
+}
+
+void sophie_index_free(struct sophie_index *index) {
+    free(index->block_remainders);
+    index->block_remainders = index->offset_factors = NULL;
+}
+
+bool sophie_at(const struct sophie_index *index, uint64_t position, uint64_t *observation) {
+    if (position >= NUM_OBSERVATIONS_MAX) {
+        return false;
+    }
+
+    // The Montgomery product of the block remainder (in Montgomery form) with
+    // the factor of the offset (as is) is the remainder at the position (as is)
+    struct montgomery mont = { (num_t)index->q, (num_t)index->montgomery_inverse, 0, 0 };
+    num_t r = montgomery_mul(&mont, (num_t)index->block_remainders[position / index->block_size],
+                             (num_t)index->offset_factors[position % index->block_size]);
+    struct reciprocal reciprocal = {
+        (num_t)index->reciprocal_divisor, (num_t)index->reciprocal_inverse, index->reciprocal_shift
+    };
+    *observation = extract_observation_chunk_reciprocal(&reciprocal, &r);
+    return true;
+}
+
+bool sophie_at_double(const struct sophie_index *index, uint64_t position, double *observation) {
+    uint64_t chunk;
+    if (!sophie_at(index, position, &chunk)) {
+        return false;
+    }
+    *observation = observation_chunk_to_double((num_t)chunk);
+    return true;
+}
+
+/// Extracts the uniformly distributed bits of an observation chunk (which is uniform in
+/// [0, 10**NUM_DIGITS_PER_OBSERVATION)) into *bits, and returns how many of them there are.
+/// Since 10**digits = 2**digits * 5**digits, the lowest digits bits of the chunk are uniform
+/// and independent of the rest of the chunk, which is uniform in [0, 5**digits). The latter
+/// is split into ranges of powers of two, from the largest one, and its offset within the
+/// range where it falls gives as many uniform bits as the size of the range (about 33 bits
+/// on average for 15 digits). This discards no observation and needs no division
+static unsigned observation_chunk_bits(num_t chunk, uint64_t *bits) {
+    const unsigned low_bits = NUM_DIGITS_PER_OBSERVATION;
+    uint64_t value = (uint64_t)chunk >> low_bits;
+    uint64_t range = (uint64_t)POW10_DIGITS_PER_OBSERVATION >> low_bits;
+    unsigned range_bits = 63 - (unsigned)__builtin_clzll(range);
+    while (value >= (UINT64_C(1) << range_bits)) {
+        value -= UINT64_C(1) << range_bits;
+        range -= UINT64_C(1) << range_bits;
+        range_bits = 63 - (unsigned)__builtin_clzll(range);
+    }
+    *bits = ((uint64_t)chunk & ((UINT64_C(1) << low_bits) - 1)) | (value << low_bits);
+    return low_bits + range_bits;
+}
+
+uint64_t sophie_next_bits(struct sophie_state *state, unsigned num_bits) {
+    assert(num_bits <= 64);
+    uint64_t result = 0;
+    unsigned count = 0;
+    for (;;) {
+        // The bits of a single chunk never fill a 64-bit integer, so the shifts are valid
+        unsigned take = num_bits - count < state->num_bits ? num_bits - count : state->num_bits;
+        if (take > 0) {
+            result |= (state->bits & ((UINT64_C(1) << take) - 1)) << count;
+            state->bits >>= take;
+            state->num_bits -= take;
+            count += take;
+        }
+        if (count == num_bits) {
+            return result;
+        }
+        state->num_bits = observation_chunk_bits((num_t)sophie_next_u64(state), &state->bits);
+    }
+}
+
+uint64_t sophie_next_bounded(struct sophie_state *state, uint64_t bound) {
+    if (bound == 0) {
+        return sophie_next_bits(state, 64);
+    }
+    if (bound <= UINT32_MAX) {
+        uint64_t product = sophie_next_bits(state, 32) * bound;
+        if ((uint32_t)product < bound) {
+            // Reject the lowest 2**32 mod bound values of the lower half, which are the excess
+            uint32_t threshold = (uint32_t)(0 - (uint32_t)bound) % (uint32_t)bound;
+            while ((uint32_t)product < threshold) {
+                product = sophie_next_bits(state, 32) * bound;
+            }
+        }
+        return product >> 32;
+    }
+
+    unsigned __int128 product = (unsigned __int128)sophie_next_bits(state, 64) * bound;
+    if ((uint64_t)product < bound) {
+        uint64_t threshold = (0 - bound) % bound;
+        while ((uint64_t)product < threshold) {
+            product = (unsigned __int128)sophie_next_bits(state, 64) * bound;
+        }
+    }
+    return (uint64_t)(product >> 64);
+}
+
+void sophie_fill_bounded(struct sophie_state *state, uint64_t *buf, size_t n, uint64_t bound) {
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = sophie_next_bounded(state, bound);
+    }
+}
+
+void sophie_fill_bits(struct sophie_state *state, uint8_t *buf, size_t n) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t bits = sophie_next_bits(state, 64);
+        for (size_t j = 0; j < sizeof(uint64_t); j++) {
+            buf[i + j] = (uint8_t)(bits >> (8 * j));
+        }
+    }
+    for (; i < n; i++) {
+        buf[i] = (uint8_t)sophie_next_bits(state, 8);
+    }
+}
+
+/// Fills the buffers with the observations of several generator states, as a double or as
+/// an integer, as sophie_fill_streams_f64 and sophie_fill_streams_u64 do, with the given
+/// variant of the multi-stream kernel
+static void fill_streams_with(const struct lane_kernel *kernel, struct sophie_state *states,
+                              size_t num_states, void *const *bufs, size_t n, bool as_double) {
+    size_t lane_states[STREAM_LANES_MAX];
+    size_t num_lanes = 0;
+    for (size_t j = 0; j <= num_states; j++) {
+        // Gather the states supported by the kernel into lanes, and fill the others one by one
+        if (j < num_states && !lane_supports_q(states[j].q)) {
+            if (as_double) {
+                sophie_fill_f64(&states[j], bufs[j], n);
+            } else {
+                sophie_fill_u64(&states[j], bufs[j], n);
+            }
+            continue;
+        }
+        if (j < num_states) {
+            lane_states[num_lanes++] = j;
+        }
+        if (num_lanes == 0 || (num_lanes < kernel->lanes && j < num_states)) {
+            continue;
+        }
+        kernel->fill_lanes(states, lane_states, num_lanes, bufs, n, as_double);
+        num_lanes = 0;
+    }
+}
+
+/// Same as fill_streams_with, with the widest variant of the multi-stream kernel for the CPU
+static void fill_streams(struct sophie_state *states, size_t num_states,
+                         void *const *bufs, size_t n, bool as_double) {
+    fill_streams_with(lane_kernel(), states, num_states, bufs, n, as_double);
+}
+
+void sophie_fill_streams_u64(struct sophie_state *states, size_t num_states,
+                             uint64_t *const *bufs, size_t n) {
+    fill_streams(states, num_states, (void *const *)bufs, n, false);
+}
+
+void sophie_fill_streams_f64(struct sophie_state *states, size_t num_states,
+                             double *const *bufs, size_t n) {
+    fill_streams(states, num_states, (void *const *)bufs, n, true);
+}
+
+const char *sophie_stream_kernel(size_t *num_lanes) {
+    const struct lane_kernel *kernel = lane_kernel();
+    if (num_lanes != NULL) {
+        *num_lanes = kernel->lanes;
+    }
+    return kernel->name;
+}
+
+/// The rest of the file is the command line program, which is left out of the library
+#ifndef SOPHIE_LIBRARY
+
+/******************
+ * RUN STATISTICS *
+ ******************/
+
+/// Formats of the report of the statistics of a run (--stats)
+enum stats_format {
+    STATS_NONE,
+    /// Human readable report
+    STATS_TEXT,
+    /// Single line JSON object, for the dashboards
+    STATS_JSON,
+};
+
+/// Names of the formats of the report of the statistics, for the command line
+static const char *const stats_format_names[] = {
+    [STATS_NONE] = "none",
+    [STATS_TEXT] = "text",
+    [STATS_JSON] = "json",
+};
+
+/// Timings of the phases of a run (in nanoseconds) and the amount of generated data.
+/// Those are always measured, since they are only taken a few times per megabyte of output
+struct run_stats {
+    wide_t q;
+    uint64_t search_ns;
+    /// Time spent generating the output, including the time spent writing it (write_ns)
+    uint64_t generation_ns;
+    uint64_t write_ns;
+    uint64_t num_observations;
+    uint64_t num_bytes;
+};
+
+/// Returns the current time of the monotonic clock, in nanoseconds
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/// Returns the given amount per second of the given time in nanoseconds
+static double per_second(uint64_t amount, uint64_t ns) {
+    return ns > 0 ? (double)amount * 1e9 / (double)ns : 0.0;
+}
+
+/// Formats the given (up to 128-bit) integer in decimal into the given buffer, and returns it
+static const char *format_wide(wide_t x, char buffer[40]) {
+    char *digits = buffer + 39;
+    *digits = '\0';
+    do {
+        *--digits = (char)('0' + (int)(x % 10));
+        x /= 10;
+    } while (x != 0);
+    return digits;
+}
+
+/// Prints the report of the statistics of a run to the standard error
+static void print_run_stats(const struct run_stats *stats, enum stats_format format) {
+    uint64_t num_digits = stats->num_observations * NUM_DIGITS_PER_OBSERVATION;
+    uint64_t compute_ns = stats->generation_ns - stats->write_ns;
+#ifdef SOPHIE_STATS
+    // The threads of the search are already joined, so the counters can be read as usual
+    struct search_stats search = search_stats;
+    uint64_t num_tested = search.candidates - search.sieve_rejections - search.filter_rejections;
+#endif
+
+    char q_buffer[40];
+    if (format == STATS_JSON) {
+        fprintf(stderr, "{\"q\":%s,\"search_seconds\":%.9f,\"generation_seconds\":%.9f,"
+                "\"write_seconds\":%.9f,\"observations\":%" PRIu64 ",\"digits\":%" PRIu64 ","
+                "\"bytes\":%" PRIu64 ",\"digits_per_second\":%.0f,\"bytes_per_second\":%.0f,\"search\":",
+                format_wide(stats->q, q_buffer), (double)stats->search_ns * 1e-9, (double)compute_ns * 1e-9,
+                (double)stats->write_ns * 1e-9, stats->num_observations, num_digits, stats->num_bytes,
+                per_second(num_digits, stats->generation_ns), per_second(stats->num_bytes, stats->generation_ns));
+#ifdef SOPHIE_STATS
+        fprintf(stderr, "{\"candidates\":%" PRIu64 ",\"sieve_rejections\":%" PRIu64 ","
+                "\"filter_rejections\":%" PRIu64 ",\"q_rejections\":%" PRIu64 ",\"p_rejections\":%" PRIu64 ","
+                "\"primality_tests\":%" PRIu64 ",\"witness_evaluations\":%" PRIu64 ",\"safe_primes\":%" PRIu64 "}}\n",
+                search.candidates, search.sieve_rejections, search.filter_rejections, search.q_rejections,
+                search.p_rejections, search.primality_tests, search.witness_evaluations, search.safe_primes);
+#else
+        fprintf(stderr, "null}\n");
+#endif
+        return;
+    }
+
+    fprintf(stderr, "Statistics:\n");
+    fprintf(stderr, "    Safe prime search: %.6f s\n", (double)stats->search_ns * 1e-9);
+    fprintf(stderr, "    Generation: %.6f s (plus %.6f s writing the output)\n",
+            (double)compute_ns * 1e-9, (double)stats->write_ns * 1e-9);
+    fprintf(stderr, "    Output: %" PRIu64 " observations, %" PRIu64 " digits, %" PRIu64 " bytes\n",
+            stats->num_observations, num_digits, stats->num_bytes);
+    fprintf(stderr, "    Throughput: %.0f digits/s, %.0f bytes/s\n",
+            per_second(num_digits, stats->generation_ns), per_second(stats->num_bytes, stats->generation_ns));
+#ifdef SOPHIE_STATS
+    fprintf(stderr, "    Search candidates: %" PRIu64 " (%" PRIu64 " rejected by the sieve, %" PRIu64
+            " by the p mod 20 filter, %" PRIu64 " by the test of q, %" PRIu64 " by the test of p)\n",
+            search.candidates, search.sieve_rejections, search.filter_rejections,
+            search.q_rejections, search.p_rejections);
+    fprintf(stderr, "    Primality tests: %" PRIu64 " (%" PRIu64 " witness evaluations, %.2f per tested candidate)\n",
+            search.primality_tests, search.witness_evaluations,
+            num_tested > 0 ? (double)search.witness_evaluations / (double)num_tested : 0.0);
+    fprintf(stderr, "    Safe primes found: %" PRIu64 "\n", search.safe_primes);
+#else
+    fprintf(stderr, "    Search counters: not available (compile with SOPHIE_STATS)\n");
+#endif
+}
+
+/*******************
+ * BUFFERED OUTPUT *
+ *******************/
+
+/// Buffered output to a file descriptor. The data is formatted directly into a large
+/// buffer, which is written with write(2) once full, avoiding the overhead of stdio.
+/// Optionally, when writing to a pipe on Linux, the buffers can be handed to the pipe
+/// with vmsplice(2), avoiding the copy of the data into the kernel. Since the pipe then
+/// references the pages of the buffer, two buffers are used in turns, and each one is
+/// only written once it holds at least as much data as the pipe, so when a buffer has been
+/// completely handed to the pipe, the other one has been completely read and can be reused
+struct output {
+    int fd;
+    bool splice;
+    char *buffers[2];
+    /// Index of the buffer being filled
+    size_t current;
+    /// Number of bytes in the buffer being filled
+    size_t size;
+    /// Number of bytes after which the buffer being filled is written
+    size_t flush_threshold;
+    /// Time spent writing to the file descriptor, in nanoseconds (for --stats)
+    uint64_t write_ns;
+    /// Whether the reader of the pipe closed it, so nothing more can be written (EPIPE)
+    bool closed;
+};
+
+/// Initializes the buffered output to the given file descriptor, and tries to
+/// use vmsplice(2) if requested. Returns false on failure
+static bool output_init(struct output *output, int fd, bool splice) {
+    output->fd = fd;
+    output->splice = false;
+    output->current = 0;
+    output->size = 0;
+    output->flush_threshold = OUTPUT_BUFFER_SIZE;
+    output->write_ns = 0;
+    output->closed = false;
+    output->buffers[0] = output->buffers[1] = NULL;
+
+#ifdef __linux__
+    struct stat st;
+    if (splice && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        fcntl(fd, F_SETPIPE_SZ, (int)OUTPUT_BUFFER_SIZE);
+        int pipe_size = fcntl(fd, F_GETPIPE_SZ);
+        if (pipe_size > 0) {
+            output->splice = true;
+            if ((size_t)pipe_size > output->flush_threshold) {
+                output->flush_threshold = (size_t)pipe_size;
+            }
+        }
+    }
+#else
+    (void)splice;
+#endif
+
+    for (size_t i = 0; i < (output->splice ? 2 : 1); i++) {
+        if (posix_memalign((void **)&output->buffers[i], (size_t)sysconf(_SC_PAGESIZE),
+                           output->flush_threshold + OUTPUT_RESERVE_MAX) != 0) {
+            fprintf(stderr, "Out of memory allocating the output buffer\n");
+            free(output->buffers[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Frees the buffers of the output (without writing their contents)
+static void output_free(struct output *output) {
+    free(output->buffers[0]);
+    free(output->buffers[1]);
+}
+
+/// Writes the given data to the file descriptor of the output, using vmsplice(2)
+/// if enabled (in which case the data must not be modified until the pipe consumes it).
+/// Returns false on failure
+static bool output_write_fd(struct output *output, const char *data, size_t size) {
+    uint64_t start_ns = monotonic_ns();
+    while (size > 0) {
+        ssize_t written;
+#ifdef __linux__
+        if (output->splice) {
+            struct iovec iov = { (void *)data, size };
+            written = vmsplice(output->fd, &iov, 1, 0);
+        } else
+#endif
+        {
+            written = write(output->fd, data, size);
+        }
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // The reader closing the pipe is not reported, since it can be the expected end
+            // (only seen if SIGPIPE is ignored, since otherwise it terminates the process)
+            if (errno == EPIPE) {
+                output->closed = true;
+            } else {
+                perror("Failed to write the output");
+            }
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    output->write_ns += monotonic_ns() - start_ns;
+    return true;
+}
+
+/// Writes the data of the buffer being filled. Returns false on failure
+static bool output_flush(struct output *output) {
+    if (!output_write_fd(output, output->buffers[output->current], output->size)) {
+        return false;
+    }
+
+    output->size = 0;
+    if (output->splice) {
+        output->current = 1 - output->current;
+    }
+    return true;
+}
+
+/// Returns where the next size (<= OUTPUT_RESERVE_MAX) bytes of data are to be formatted.
+/// Once formatted, they must be committed with output_commit
+static char *output_reserve(struct output *output, size_t size) {
+    assert(size <= OUTPUT_RESERVE_MAX);
+    (void)size;
+    return output->buffers[output->current] + output->size;
+}
+
+/// Commits the given number of bytes formatted at the place returned by output_reserve,
+/// writing the buffer if it is full. Returns false on failure
+static bool output_commit(struct output *output, size_t size) {
+    output->size += size;
+    return output->size < output->flush_threshold || output_flush(output);
+}
+
+/// Writes the given data into the output. Returns false on failure
+static bool output_write(struct output *output, const char *data, size_t size) {
+    // Large writes skip the buffer, unless it needs to hold the data for vmsplice
+    if (!output->splice && output->size == 0 && size >= output->flush_threshold) {
+        return output_write_fd(output, data, size);
+    }
+
+    while (size > 0) {
+        size_t chunk_size = output->flush_threshold - output->size;
+        if (chunk_size > size) {
+            chunk_size = size;
+        }
+        memcpy(output->buffers[output->current] + output->size, data, chunk_size);
+        if (!output_commit(output, chunk_size)) {
+            return false;
+        }
+        data += chunk_size;
+        size -= chunk_size;
+    }
+    return true;
+}
+
+/**********************
+ * OBSERVATION OUTPUT *
+ **********************/
+
+/// Precomputed multiply-shift reciprocal of a divisor q, only for the dividends of the digit
+/// extraction, r*10**NUM_DIGITS_PER_OBSERVATION with r < q. Since those quotients have fewer bits
+/// than q (for digits so few that 10**NUM_DIGITS_PER_OBSERVATION < 2**(NUM_BITS-1)),
+/// multiplier = floor(2**shift * 10**NUM_DIGITS_PER_OBSERVATION / q) fits a num_t for some
+/// shift with 2**shift > q, and floor(r * multiplier / 2**shift) is the quotient or one less.
+/// This needs a single double-width multiplication and one correction, instead of the two
+/// multiplications (and the shift of the dividend) and two corrections of divide_reciprocal.
+/// The remainder is computed modulo 2**NUM_BITS, so it is exact if 2*q fits a num_t
+/// (see narrow_reciprocal_supports_q)
+struct narrow_reciprocal {
+    num_t divisor;
+    num_t multiplier;
+    unsigned shift;
+};
+
+/// Returns whether the narrow reciprocal can divide by q, that is, whether 2*q fits a num_t,
+/// which holds for every q of the default configuration (note that the multi-stream kernel has
+/// a similar condition for its double precision arithmetic, see lane_supports_q)
+static bool narrow_reciprocal_supports_q(num_t q) {
+    return q <= NUM_MAX / 2;
+}
+
+/// Precomputes the narrow reciprocal of the given divisor (which must be supported)
+static struct narrow_reciprocal compute_narrow_reciprocal(num_t divisor) {
+    struct narrow_reciprocal reciprocal = { divisor, 0, 0 };
+    while (((bignum_t)POW10_DIGITS_PER_OBSERVATION << (reciprocal.shift + 1)) / divisor <= NUM_MAX) {
+        reciprocal.shift++;
+    }
+    reciprocal.multiplier = (num_t)(((bignum_t)POW10_DIGITS_PER_OBSERVATION << reciprocal.shift) / divisor);
+    assert(((bignum_t)1 << reciprocal.shift) > divisor &&
+           "Invalid configuration: 10**NUM_DIGITS_PER_OBSERVATION is too large for the narrow reciprocal.");
+    return reciprocal;
+}
+
+/// Same as extract_observation_chunk_reciprocal, but with the narrow reciprocal of q
+static num_t extract_observation_chunk_narrow(const struct narrow_reciprocal *reciprocal, num_t *r) {
+    num_t quotient = (num_t)(((bignum_t)*r * reciprocal->multiplier) >> reciprocal->shift);
+    num_t remainder = (num_t)((num_t)(*r * POW10_DIGITS_PER_OBSERVATION) -
+                              (num_t)(quotient * reciprocal->divisor));
+    if (remainder >= reciprocal->divisor) {
+        quotient = (num_t)(quotient + 1);
+        remainder = (num_t)(remainder - reciprocal->divisor);
+    }
+    *r = remainder;
+    return quotient;
+}
+
+/// Strategies to extract the digits of the decimal expansion of 1/q
+enum division_strategy {
+    /// One long division step per digit (reference implementation)
+    DIVISION_DIGIT,
+    /// One long division step per observation
+    DIVISION_CHUNK,
+    /// One long division step per observation, using a precomputed reciprocal of q
+    /// (the narrow one if q supports it, see narrow_reciprocal_supports_q)
+    DIVISION_RECIPROCAL,
+};
+
+/// Names of the division strategies, for the command line
+static const char *const division_strategy_names[] = {
+    [DIVISION_DIGIT] = "digit",
+    [DIVISION_CHUNK] = "chunk",
+    [DIVISION_RECIPROCAL] = "reciprocal",
+};
+
+/// Decimal expansion of 1/q, with the data precomputed for its digit extraction
+struct expansion {
+    num_t q;
+    enum division_strategy division;
+    struct reciprocal reciprocal;
+    /// Whether the divisions by the reciprocal use the narrow one, which is picked
+    /// once for q, so the extraction of every observation only branches on it
+    bool narrow;
+    struct narrow_reciprocal narrow_reciprocal;
+};
+
+/// Prepares the generation of the decimal expansion of 1/q using the given strategy
+static struct expansion init_expansion(num_t q, enum division_strategy division) {
+    struct expansion expansion = { q, division, compute_reciprocal(q), false, { q, 0, 0 } };
+    if (division == DIVISION_RECIPROCAL && narrow_reciprocal_supports_q(q)) {
+        expansion.narrow = true;
+        expansion.narrow_reciprocal = compute_narrow_reciprocal(q);
+    }
+    return expansion;
+}
+
+/// Extracts an observation of the decimal expansion of 1/q from the given remainder
+/// as an integer of NUM_DIGITS_PER_OBSERVATION digits (a "chunk"), using a simple
+/// long-division based decimal digit extraction algorithm.
+/// Stores the remainder after the last extracted digit into *r
+static num_t extract_observation_digits(num_t found_q, num_t *r) {
+    num_t chunk = 0;
+    for (size_t j = 0; j < NUM_DIGITS_PER_OBSERVATION; j++) {
+        chunk = (num_t)(chunk * 10 + (*r * 10) / found_q);
+        *r = (num_t)((*r * 10) % found_q);
+    }
+    return chunk;
+}
+
+/// Same as extract_observation_digits, but does all the digits in a single division
+/// of r*10**NUM_DIGITS_PER_OBSERVATION, which can't overflow since r < q
+static num_t extract_observation_chunk(num_t found_q, num_t *r) {
+    bignum_t dividend = (bignum_t)*r * POW10_DIGITS_PER_OBSERVATION;
+    *r = (num_t)(dividend % found_q);
+    return (num_t)(dividend / found_q);
+}
+
+/// Extracts an observation of the decimal expansion of 1/q from the given remainder
+/// as a chunk using the specified strategy (all of them give the same result).
+/// Stores the remainder after the last extracted digit into *r
+static num_t extract_observation(const struct expansion *expansion, num_t *r) {
+    switch (expansion->division) {
+    case DIVISION_RECIPROCAL:
+        if (expansion->narrow) {
+            return extract_observation_chunk_narrow(&expansion->narrow_reciprocal, r);
+        }
+        return extract_observation_chunk_reciprocal(&expansion->reciprocal, r);
+    case DIVISION_CHUNK:
+        return extract_observation_chunk(expansion->q, r);
+    case DIVISION_DIGIT:
+    default:
+        return extract_observation_digits(expansion->q, r);
+    }
+}
+
+/// Output formats of the observations
+enum output_format {
+    /// Text lines with the decimal representation of the observations ("0.583510471406548\n")
+    FORMAT_TEXT,
+    /// Native doubles with the value of the observations (the same as parsing the text lines)
+    FORMAT_F64,
+    /// Native 64-bit unsigned integers with the digits of the observations (583510471406548)
+    FORMAT_U64,
+    /// Stream of the decimal digits of the observations as ASCII, without any separator
+    FORMAT_DIGITS,
+};
+
+/// Names of the output formats, for the command line
+static const char *const output_format_names[] = {
+    [FORMAT_TEXT] = "text",
+    [FORMAT_F64] = "f64",
+    [FORMAT_U64] = "u64",
+    [FORMAT_DIGITS] = "digits",
+};
+
+/// Size of the text line of an observation ("0." + digits + "\n")
+#define OBSERVATION_LINE_SIZE (NUM_DIGITS_PER_OBSERVATION + 3)
+
+/// Size of an observation in each output format
+static const size_t output_format_sizes[] = {
+    [FORMAT_TEXT] = OBSERVATION_LINE_SIZE,
+    [FORMAT_F64] = sizeof(double),
+    [FORMAT_U64] = sizeof(uint64_t),
+    [FORMAT_DIGITS] = NUM_DIGITS_PER_OBSERVATION,
+};
+
+/// Decimal digits of all the numbers from 0 to 99, in pairs ("00", "01", ..., "99")
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/// Writes the given number of decimal digits of the value, left-padded with zeros,
+/// two digits at a time through the table of digit pairs
+static void format_digits(uint32_t value, char *digits, size_t num_digits) {
+    size_t j = num_digits;
+    for (; j >= 2; j -= 2) {
+        memcpy(&digits[j - 2], &digit_pairs[2 * (value % 100)], 2);
+        value /= 100;
+    }
+    if (j == 1) {
+        digits[0] = (char)('0' + value);
+    }
+}
+
+/// Writes the decimal digits of an observation chunk, left-padded with zeros.
+/// The chunk is split into groups of 8 digits, which are formatted independently
+/// (so their dependency chains overlap) in 32-bit arithmetic
+static void format_observation_chunk(num_t chunk, char *digits) {
+    size_t j = NUM_DIGITS_PER_OBSERVATION;
+    for (; j > 8; j -= 8) {
+        format_digits((uint32_t)(chunk % 100000000), &digits[j - 8], 8);
+        chunk = (num_t)(chunk / 100000000);
+    }
+    format_digits((uint32_t)chunk, digits, j);
+}
+
+/// Formats an observation chunk in the given output format
+/// (output_format_sizes[format] bytes)
+static void format_observation(enum output_format format, num_t chunk, char *dest) {
+    switch (format) {
+    case FORMAT_F64: {
+        double value = observation_chunk_to_double(chunk);
+        memcpy(dest, &value, sizeof(value));
+        break;
+    }
+    case FORMAT_U64: {
+        uint64_t value = chunk;
+        memcpy(dest, &value, sizeof(value));
+        break;
+    }
+    case FORMAT_DIGITS:
+        format_observation_chunk(chunk, dest);
+        break;
+    case FORMAT_TEXT:
+    default:
+        dest[0] = '0';
+        dest[1] = '.';
+        format_observation_chunk(chunk, dest + 2);
+        dest[OBSERVATION_LINE_SIZE - 1] = '\n';
+        break;
+    }
+}
+
+/// Generates the given number of observations of the expansion from the remainder *r,
+/// which is updated to the remainder after them, and writes them into the given output.
+/// Returns false on failure
+static bool generate_observations_from(const struct expansion *expansion,
+                                       enum output_format format,
+                                       num_t num_observations, num_t *r,
+                                       struct output *output) {
+    // (A local copy, since the stores into the output could alias the remainder)
+    size_t observation_size = output_format_sizes[format];
+    num_t local_r = *r;
+    bool success = true;
+    for (num_t i = 0; i < num_observations && success; i++) {
+        format_observation(format, extract_observation(expansion, &local_r),
+                           output_reserve(output, observation_size));
+        success = output_commit(output, observation_size);
+    }
+    *r = local_r;
+    return success;
+}
+
+/// Generates the given observations of the decimal expansion of 1/q in this thread.
+/// Returns false on failure
+static bool generate_observations_serial(const struct expansion *expansion,
+                                         enum output_format format,
+                                         num_t num_observations, num_t offset,
+                                         struct output *output) {
+    num_t r = jump_ahead_remainder(expansion->q, offset);
+    return generate_observations_from(expansion, format, num_observations, &r, output);
+}
+
+/// Returns the number of whole observations in the period of the decimal expansion of 1/q,
+/// which is maximally periodic (its digits repeat after q - 1 digits, and not before)
+static num_t period_observations(num_t found_q) {
+    return (num_t)((found_q - 1) / NUM_DIGITS_PER_OBSERVATION);
+}
+
+/// Generates the observations of the decimal expansion of 1/q in this thread, from the given
+/// one, until the reader of the output closes it (which is not an error), or until the next
+/// observation would not be within the period of the expansion, using constant memory.
+/// Stores the number of generated observations into *num_observations.
+/// Returns false on failure
+static bool generate_observations_unbounded(const struct expansion *expansion,
+                                            enum output_format format, num_t offset,
+                                            struct output *output, uint64_t *num_observations) {
+    num_t end = period_observations(expansion->q);
+    num_t r = jump_ahead_remainder(expansion->q, offset);
+    *num_observations = 0;
+    for (num_t next = offset; next < end; ) {
+        num_t block_size = end - next < UNBOUNDED_BLOCK_OBSERVATIONS ? (num_t)(end - next) :
+                                                                       UNBOUNDED_BLOCK_OBSERVATIONS;
+        if (!generate_observations_from(expansion, format, block_size, &r, output)) {
+            return output->closed;
+        }
+        next = (num_t)(next + block_size);
+        *num_observations += block_size;
+    }
+    fprintf(stderr, "Stopping at observation %" PRInum ", the end of the period of 1/%" PRInum
+            " (its digits repeat after the first %" PRInum ")\n", end, expansion->q,
+            (num_t)(expansion->q - 1));
+    return true;
+}
+
+/// Block of contiguous observations generated by a worker thread in the multi-threaded mode
+struct observation_block {
+    pthread_t thread;
+    const struct expansion *expansion;
+    enum output_format format;
+    num_t first_observation;
+    size_t num_observations;
+    char *data;
+};
+
+/// Entry point of a worker thread, which generates and formats a block of observations
+/// (also called directly by the workers of the multi-threaded mode)
+static void *generate_observation_block(void *block_ptr) {
+    struct observation_block *block = block_ptr;
+
+    num_t r = jump_ahead_remainder(block->expansion->q, block->first_observation);
+    size_t observation_size = output_format_sizes[block->format];
+    char *dest = block->data;
+    for (size_t i = 0; i < block->num_observations; i++, dest += observation_size) {
+        format_observation(block->format, extract_observation(block->expansion, &r), dest);
+    }
+    return NULL;
+}
+
+/// Allocates the space of the first size bytes of the given (empty) file, so that writing
+/// them through a memory mapping can't fail for the lack of space. If the file system doesn't
+/// support posix_fallocate, they are written with zeros instead. Returns false on failure
+static bool reserve_file_space(int fd, size_t size) {
+    int error = posix_fallocate(fd, 0, (off_t)size);
+    if (error == 0) {
+        return true;
+    }
+    if (error != EOPNOTSUPP) {
+        errno = error;
+        perror("Failed to allocate the output file (posix_fallocate)");
+        return false;
+    }
+
+    static const char zeros[OUTPUT_RESERVE_MAX];
+    for (size_t written = 0; written < size; ) {
+        size_t chunk_size = size - written < sizeof(zeros) ? size - written : sizeof(zeros);
+        ssize_t result = pwrite(fd, zeros, chunk_size, (off_t)written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            perror("Failed to allocate the output file (write)");
+            return false;
+        }
+        written += (size_t)result;
+    }
+    return true;
+}
+
+/// Generates the given observations of the decimal expansion of 1/q directly into the
+/// memory mapping of the given output file, whose size is known beforehand (since all the
+/// observations have the same size). Every thread formats a contiguous range of observations
+/// (seeded through jump-ahead) into its region of the mapping, so no data is copied nor
+/// ordered. Returns false on failure
+static bool generate_observations_mapped(const struct expansion *expansion,
+                                         enum output_format format,
+                                         num_t num_observations, num_t offset,
+                                         size_t num_threads, const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        perror("Failed to open the output file");
+        return false;
+    }
+
+    // The space is reserved beforehand, since running out of it while writing into the
+    // mapping would raise SIGBUS instead of failing
+    size_t size = (size_t)num_observations * output_format_sizes[format];
+    if (size == 0) {
+        return close(fd) == 0;
+    }
+    if (!reserve_file_space(fd, size)) {
+        close(fd);
+        return false;
+    }
+
+    char *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("Failed to map the output file (mmap)");
+        close(fd);
+        return false;
+    }
+
+    struct observation_block blocks[THREADS_MAX];
+    size_t num_started = 0;
+    bool success = true;
+    for (; num_started < num_threads; num_started++) {
+        struct observation_block *block = &blocks[num_started];
+        size_t first = num_observations * num_started / num_threads;
+        size_t last = num_observations * (num_started + 1) / num_threads;
+        block->expansion = expansion;
+        block->format = format;
+        block->first_observation = (num_t)(offset + first);
+        block->num_observations = last - first;
+        block->data = data + first * output_format_sizes[format];
+        if (pthread_create(&block->thread, NULL, generate_observation_block, block) != 0) {
+            fprintf(stderr, "Failed to create a worker thread\n");
+            success = false;
+            break;
+        }
+    }
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(blocks[i].thread, NULL);
+    }
+
+    // Write the mapping back, so the errors of the write-back are reported
+    if (success && msync(data, size, MS_SYNC) != 0) {
+        perror("Failed to write the output file (msync)");
+        success = false;
+    }
+    if (munmap(data, size) != 0) {
+        perror("Failed to unmap the output file (munmap)");
+        success = false;
+    }
+    if (close(fd) != 0) {
+        perror("Failed to close the output file (close)");
+        success = false;
+    }
+    return success;
+}
+
+/// Block of raw observation chunks, which is passed from a generator thread to the writer
+struct chunk_block {
+    size_t num_observations;
+    num_t chunks[PIPELINE_BLOCK_OBSERVATIONS];
+};
+
+/// Lock-free single-producer single-consumer ring of blocks (struct chunk_block in the
+/// pipelined mode, and struct observation_block in the multi-threaded mode). Only the producer
+/// writes the tail and only the consumer writes the head, each one in its own cache line
+struct block_ring {
+    size_t head __attribute__((aligned(CACHE_LINE_SIZE)));
+    size_t tail __attribute__((aligned(CACHE_LINE_SIZE)));
+    void *slots[PIPELINE_GENERATOR_BLOCKS];
+};
+
+/// Pushes a block into the ring (from the producer). Returns false if it is full
+static bool block_ring_push(struct block_ring *ring, void *block) {
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == PIPELINE_GENERATOR_BLOCKS) {
+        return false;
+    }
+    ring->slots[tail % PIPELINE_GENERATOR_BLOCKS] = block;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/// Pops a block from the ring (from the consumer). Returns NULL if it is empty
+static void *block_ring_pop(struct block_ring *ring) {
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    void *block = ring->slots[head % PIPELINE_GENERATOR_BLOCKS];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return block;
+}
+
+/// Observations which are generated in the pipelined and the multi-threaded modes,
+/// shared by all the threads
+struct pipeline {
+    const struct expansion *expansion;
+    /// Format of the observations (only used by the workers of the multi-threaded mode)
+    enum output_format format;
+    num_t offset;
+    num_t num_observations;
+    size_t num_blocks;
+    size_t num_generators;
+    /// Set by the writer to stop the generators (e.g. if the output fails)
+    bool stop;
+};
+
+/// Generator thread of the pipelined mode (or worker of the multi-threaded mode),
+/// which generates the blocks index, index + num_generators, index + 2*num_generators, ...
+struct pipeline_generator {
+    /// Generated blocks, from the generator to the writer
+    struct block_ring filled;
+    /// Blocks which have been written and can be reused, from the writer to the generator
+    struct block_ring free;
+    const struct pipeline *pipeline;
+    size_t index;
+    pthread_t thread;
+};
+
+/// Entry point of a generator thread of the pipelined mode
+static void *run_pipeline_generator(void *generator_ptr) {
+    struct pipeline_generator *generator = generator_ptr;
+    const struct pipeline *pipeline = generator->pipeline;
+
+    for (size_t k = generator->index; k < pipeline->num_blocks; k += pipeline->num_generators) {
+        // Wait until the writer gives back a block (if there's none, it is behind us)
+        struct chunk_block *block;
+        while ((block = block_ring_pop(&generator->free)) == NULL) {
+            if (__atomic_load_n(&pipeline->stop, __ATOMIC_RELAXED)) {
+                return NULL;
+            }
+            sched_yield();
+        }
+
+        size_t first = k * PIPELINE_BLOCK_OBSERVATIONS;
+        size_t remaining = (size_t)pipeline->num_observations - first;
+        block->num_observations = remaining < PIPELINE_BLOCK_OBSERVATIONS ?
+            remaining : PIPELINE_BLOCK_OBSERVATIONS;
+        num_t r = jump_ahead_remainder(pipeline->expansion->q, (num_t)(pipeline->offset + first));
+        for (size_t i = 0; i < block->num_observations; i++) {
+            block->chunks[i] = extract_observation(pipeline->expansion, &r);
+        }
+
+        // This never fails, since the ring can hold all the blocks of the generator
+        block_ring_push(&generator->filled, block);
+    }
+    return NULL;
+}
+
+/// Generates the given observations of the decimal expansion of 1/q in a pipeline, where
+/// several generator threads extract the chunks in blocks (seeded through jump-ahead), and
+/// this thread formats and writes them in order meanwhile. The blocks are passed through
+/// lock-free rings, and recycled from a pool which is preallocated, so the generators
+/// only wait for the writer when they are a few blocks ahead. Returns false on failure
+static bool generate_observations_pipelined(const struct expansion *expansion,
+                                            enum output_format format,
+                                            num_t num_observations, num_t offset,
+                                            size_t num_threads, struct output *output) {
+    struct pipeline pipeline = {
+        expansion, format, offset, num_observations,
+        ((size_t)num_observations + PIPELINE_BLOCK_OBSERVATIONS - 1) / PIPELINE_BLOCK_OBSERVATIONS,
+        num_threads, false
+    };
+
+    struct pipeline_generator *generators = NULL;
+    struct chunk_block *blocks = malloc(num_threads * PIPELINE_GENERATOR_BLOCKS * sizeof(*blocks));
+    if (posix_memalign((void **)&generators, CACHE_LINE_SIZE, num_threads * sizeof(*generators)) != 0 ||
+        blocks == NULL) {
+        fprintf(stderr, "Out of memory allocating the blocks for %zu threads\n", num_threads);
+        free(generators);
+        free(blocks);
+        return false;
+    }
+
+    bool success = true;
+    size_t num_started = 0;
+    for (; num_started < num_threads; num_started++) {
+        struct pipeline_generator *generator = &generators[num_started];
+        memset(generator, 0, sizeof(*generator));
+        generator->pipeline = &pipeline;
+        generator->index = num_started;
+        for (size_t i = 0; i < PIPELINE_GENERATOR_BLOCKS; i++) {
+            block_ring_push(&generator->free, &blocks[num_started * PIPELINE_GENERATOR_BLOCKS + i]);
+        }
+        if (pthread_create(&generator->thread, NULL, run_pipeline_generator, generator) != 0) {
+            fprintf(stderr, "Failed to create a worker thread\n");
+            success = false;
+            break;
+        }
+    }
+
+    size_t observation_size = output_format_sizes[format];
+    for (size_t k = 0; k < pipeline.num_blocks && success; k++) {
+        struct pipeline_generator *generator = &generators[k % num_threads];
+        struct chunk_block *block;
+        while ((block = block_ring_pop(&generator->filled)) == NULL) {
+            sched_yield();
+        }
+
+        for (size_t i = 0; i < block->num_observations && success; i++) {
+            format_observation(format, block->chunks[i], output_reserve(output, observation_size));
+            success = output_commit(output, observation_size);
+        }
+        block_ring_push(&generator->free, block);
+    }
+
+    __atomic_store_n(&pipeline.stop, true, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(generators[i].thread, NULL);
+    }
+    free(generators);
+    free(blocks);
+    return success;
+}
+
+/// Entry point of a worker thread of the multi-threaded mode, which generates and formats
+/// its blocks of THREAD_BLOCK_OBSERVATIONS observations into the buffers given back by the writer
+static void *run_parallel_worker(void *worker_ptr) {
+    struct pipeline_generator *worker = worker_ptr;
+    const struct pipeline *pipeline = worker->pipeline;
+
+    for (size_t k = worker->index; k < pipeline->num_blocks; k += pipeline->num_generators) {
+        struct observation_block *block;
+        while ((block = block_ring_pop(&worker->free)) == NULL) {
+            if (__atomic_load_n(&pipeline->stop, __ATOMIC_RELAXED)) {
+                return NULL;
+            }
+            sched_yield();
+        }
+
+        size_t first = k * THREAD_BLOCK_OBSERVATIONS;
+        size_t remaining = (size_t)pipeline->num_observations - first;
+        block->first_observation = (num_t)(pipeline->offset + first);
+        block->num_observations = remaining < THREAD_BLOCK_OBSERVATIONS ?
+            remaining : THREAD_BLOCK_OBSERVATIONS;
+        generate_observation_block(block);
+        block_ring_push(&worker->filled, block);
+    }
+    return NULL;
+}
+
+/// Generates the given observations of the decimal expansion of 1/q using several threads.
+/// A pool of worker threads is started once, and every worker generates and formats every
+/// num_threads-th block (seeded through jump-ahead) into one of its two buffers, while this
+/// thread writes the blocks in order, so the output is the same as in the single-threaded mode.
+/// The blocks are passed through the same lock-free rings as in the pipelined mode.
+/// Returns false on failure
+static bool generate_observations_parallel(const struct expansion *expansion,
+                                           enum output_format format,
+                                           num_t num_observations, num_t offset,
+                                           size_t num_threads, struct output *output) {
+    struct pipeline pipeline = {
+        expansion, format, offset, num_observations,
+        ((size_t)num_observations + THREAD_BLOCK_OBSERVATIONS - 1) / THREAD_BLOCK_OBSERVATIONS,
+        num_threads, false
+    };
+
+    size_t block_size = THREAD_BLOCK_OBSERVATIONS * output_format_sizes[format];
+    struct pipeline_generator *workers = NULL;
+    struct observation_block *blocks = calloc(2 * num_threads, sizeof(*blocks));
+    char *data = malloc(2 * num_threads * block_size);
+    if (posix_memalign((void **)&workers, CACHE_LINE_SIZE, num_threads * sizeof(*workers)) != 0 ||
+        blocks == NULL || data == NULL) {
+        fprintf(stderr, "Out of memory allocating the blocks for %zu threads\n", num_threads);
+        free(workers);
+        free(blocks);
+        free(data);
+        return false;
+    }
+
+    bool success = true;
+    size_t num_started = 0;
+    for (; num_started < num_threads; num_started++) {
+        struct pipeline_generator *worker = &workers[num_started];
+        memset(worker, 0, sizeof(*worker));
+        worker->pipeline = &pipeline;
+        worker->index = num_started;
+        for (size_t i = 0; i < 2; i++) {
+            struct observation_block *block = &blocks[num_started * 2 + i];
+            block->expansion = expansion;
+            block->format = format;
+            block->data = data + (num_started * 2 + i) * block_size;
+            block_ring_push(&worker->free, block);
+        }
+        if (pthread_create(&worker->thread, NULL, run_parallel_worker, worker) != 0) {
+            fprintf(stderr, "Failed to create a worker thread\n");
+            success = false;
+            break;
+        }
+    }
+
+    for (size_t k = 0; k < pipeline.num_blocks && success; k++) {
+        struct pipeline_generator *worker = &workers[k % num_threads];
+        struct observation_block *block;
+        while ((block = block_ring_pop(&worker->filled)) == NULL) {
+            sched_yield();
+        }
+
+        success = output_write(output, block->data, block->num_observations * output_format_sizes[format]);
+        block_ring_push(&worker->free, block);
+    }
+
+    __atomic_store_n(&pipeline.stop, true, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    free(workers);
+    free(blocks);
+    free(data);
+    return success;
+}
+
+/***************
+ * CHECKPOINTS *
+ ***************/
+
+/// State of a run, which is periodically saved into a checkpoint file, so that an interrupted
+/// run can be resumed exactly where it left off, without searching the safe prime again
+/// nor generating the preceding observations
+struct checkpoint {
+    num_t seed;
+    num_t q;
+    /// Remainder of the long division right before the next observation
+    num_t r;
+    /// Index of the next observation, and of the one after the last observation of the run
+    num_t next;
+    num_t end;
+    enum output_format format;
+    /// Size of the output (if it is a regular file) after the observations before the next
+    /// one, or -1 if unknown. The output written after the last checkpoint is truncated when
+    /// resuming, so the output is the same as the one of an uninterrupted run
+    int64_t output_size;
+};
+
+/// Version of the format of the checkpoint files
+#define CHECKPOINT_VERSION 1
+
+/// Writes the checkpoint into the given path. To never leave a partial checkpoint,
+/// it is written into a temporary file, which then replaces the previous one.
+/// Returns false on failure
+static bool write_checkpoint(const char *path, const struct checkpoint *checkpoint) {
+    size_t path_size = strlen(path) + sizeof(".tmp");
+    char *temp_path = malloc(path_size);
+    if (temp_path == NULL) {
+        fprintf(stderr, "Out of memory writing the checkpoint\n");
+        return false;
+    }
+    snprintf(temp_path, path_size, "%s.tmp", path);
+
+    FILE *file = fopen(temp_path, "w");
+    bool success = file != NULL;
+    if (success) {
+        fprintf(file, "sophie-checkpoint %d\n", CHECKPOINT_VERSION);
+        fprintf(file, "num_bits %zu\nseed %" PRInum "\nq %" PRInum "\nr %" PRInum "\n",
+                sizeof(num_t) * CHAR_BIT, checkpoint->seed, checkpoint->q, checkpoint->r);
+        fprintf(file, "next %" PRInum "\nend %" PRInum "\nformat %s\noutput_size %" PRId64 "\n",
+                checkpoint->next, checkpoint->end, output_format_names[checkpoint->format],
+                checkpoint->output_size);
+        success = fflush(file) == 0 && fsync(fileno(file)) == 0;
+        success = fclose(file) == 0 && success;
+    }
+    success = success && rename(temp_path, path) == 0;
+    if (!success) {
+        perror("Failed to write the checkpoint");
+    }
+    free(temp_path);
+    return success;
+}
+
+/// Reads the checkpoint from the given path, and checks that it is valid for this
+/// configuration. Returns false on failure
+static bool read_checkpoint(const char *path, struct checkpoint *checkpoint) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror("Failed to open the checkpoint");
+        return false;
+    }
+
+    int version;
+    size_t num_bits, format_index = 0;
+    char format_name[16];
+    bool valid = fscanf(file, "sophie-checkpoint %d num_bits %zu seed %" SCNnum " q %" SCNnum
+                        " r %" SCNnum " next %" SCNnum " end %" SCNnum " format %15s output_size %" SCNd64,
+                        &version, &num_bits, &checkpoint->seed, &checkpoint->q, &checkpoint->r,
+                        &checkpoint->next, &checkpoint->end, format_name, &checkpoint->output_size) == 9;
+    fclose(file);
+    while (valid && format_index < ARRAY_SIZE(output_format_names) &&
+           strcmp(format_name, output_format_names[format_index]) != 0) {
+        format_index++;
+    }
+
+    // Besides the configuration, check the state against the seed, so a corrupted checkpoint
+    // is detected (this is cheap, unlike generating the observations before the next one):
+    // q must be the safe prime of the seed, which is searched again, and valid for it
+    valid = valid && version == CHECKPOINT_VERSION && num_bits == sizeof(num_t) * CHAR_BIT &&
+            format_index < ARRAY_SIZE(output_format_names) &&
+            checkpoint->seed <= SEED_MAX && checkpoint->next <= checkpoint->end &&
+            checkpoint->end <= NUM_OBSERVATIONS_MAX &&
+            checkpoint->q == generate_sophie_germain_safe_prime(seed_min_q(checkpoint->seed),
+                                                                PRIMALITY_MINIMAL) &&
+            valid_seed_q(checkpoint->seed, checkpoint->q) &&
+            checkpoint->r == jump_ahead_remainder(checkpoint->q, checkpoint->next);
+    if (!valid) {
+        fprintf(stderr, "Invalid checkpoint %s\n", path);
+        return false;
+    }
+    checkpoint->format = (enum output_format)format_index;
+    return true;
+}
+
+/// Returns the size of the output if it is a regular file, or -1 otherwise
+static int64_t output_file_size(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? (int64_t)st.st_size : -1;
+}
+
+/// Generates the remaining observations of the run of the checkpoint in this thread, saving
+/// the checkpoint into the given path every CHECKPOINT_INTERVAL_OBSERVATIONS observations,
+/// once they are written. Returns false on failure
+static bool generate_observations_checkpointed(const struct expansion *expansion,
+                                               struct checkpoint *checkpoint, const char *path,
+                                               struct output *output) {
+    while (checkpoint->next < checkpoint->end) {
+        num_t num_observations = (num_t)(checkpoint->end - checkpoint->next);
+        if (num_observations > CHECKPOINT_INTERVAL_OBSERVATIONS) {
+            num_observations = CHECKPOINT_INTERVAL_OBSERVATIONS;
+        }
+        if (!generate_observations_from(expansion, checkpoint->format, num_observations,
+                                        &checkpoint->r, output) ||
+            !output_flush(output)) {
+            return false;
+        }
+
+        checkpoint->next = (num_t)(checkpoint->next + num_observations);
+        // The observations are synced before the checkpoint which counts them, so after a crash
+        // the output is never shorter than its size in the checkpoint
+        checkpoint->output_size = output_file_size(output->fd);
+        if (checkpoint->output_size >= 0 && fsync(output->fd) != 0) {
+            perror("Failed to sync the output");
+            return false;
+        }
+        if (!write_checkpoint(path, checkpoint)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*************************************************
+ * TABLE OF PRECOMPUTED SAFE PRIMES FOR EACH SEED *
+ *************************************************/
+
+/// Header of the file containing the table of precomputed Sophie-Germain safe primes.
+/// It is followed by SEED_MAX + 1 entries of type seed_table_entry_t (in native byte order),
+/// each one containing (q - seed_min_q(seed)) for the seed in its lower 16 bits, and a check
+/// of the entry in its upper 16 bits (see seed_table_entry). The configuration is stored
+/// in the header, so a table generated with a different configuration is never used
+struct seed_table_header {
+    char magic[8];
+    uint64_t num_bits;
+    uint64_t num_observations_max;
+    uint64_t seed_max;
+    uint64_t num_digits_per_observation;
+    uint64_t num_prime_germain_gap_max;
+};
+
+typedef uint32_t seed_table_entry_t;
+
+#define SEED_TABLE_MAGIC "SOPHIE2"
+
+/// Returns the entry of the seed table for the given seed, whose safe prime is at the given
+/// distance (< 2**16) from seed_min_q(seed). The check is a hash of the seed and the distance,
+/// so a corrupted entry, or an entry of another seed, is detected when it is looked up
+/// without reading the rest of the table
+static seed_table_entry_t seed_table_entry(num_t seed, uint32_t distance) {
+    uint64_t hash = (((uint64_t)seed << 16) | distance) * UINT64_C(0x9E3779B97F4A7C15);
+    hash ^= hash >> 29;
+    hash *= UINT64_C(0xBF58476D1CE4E5B9);
+    return (seed_table_entry_t)(((hash >> 48) << 16) | distance);
+}
+
+/// Returns the header of the seed table for the current configuration
+static struct seed_table_header seed_table_header(void) {
+    struct seed_table_header header = {
+        SEED_TABLE_MAGIC, NUM_BITS, NUM_OBSERVATIONS_MAX, SEED_MAX,
+        NUM_DIGITS_PER_OBSERVATION, NUM_PRIME_GERMAIN_GAP_MAX
+    };
+    return header;
+}
+
+/// Searches the Sophie-Germain safe prime for every seed and writes the seed table
+/// to the given path. Returns false on failure
+static bool write_seed_table(const char *path, enum primality_engine primality, size_t num_threads) {
+    num_t *qs = malloc(((size_t)SEED_MAX + 1) * sizeof(*qs));
+    if (qs == NULL || !search_seeds(0, (size_t)SEED_MAX + 1, qs, primality, num_threads)) {
+        free(qs);
+        return false;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        free(qs);
+        return false;
+    }
+
+    struct seed_table_header header = seed_table_header();
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (num_t seed = 0; success; seed++) {
+        // The entries are stored even if they are beyond NUM_PRIME_GERMAIN_GAP_MAX,
+        // so the generator behaves the same with or without the table
+        num_t found_q = qs[seed];
+        uint64_t distance = (num_t)(found_q - seed_min_q(seed));
+        seed_table_entry_t entry = seed_table_entry(seed, (uint32_t)(distance & 0xFFFF));
+        if (found_q == 0 || distance > 0xFFFF) {
+            fprintf(stderr, "The safe prime for seed %" PRInum " can't be stored in the table\n", seed);
+            fclose(file);
+            free(qs);
+            return false;
+        }
+
+        success = fwrite(&entry, sizeof(entry), 1, file) == 1;
+        if (seed == SEED_MAX) {
+            break;
+        }
+    }
+    free(qs);
+
+    if (fclose(file) != 0 || !success) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+/// Looks up the Sophie-Germain safe prime for the given seed in the seed table
+/// at the given path, which is mapped into memory so only the required entry is read.
+/// Returns 0 if the table is absent or invalid (e.g. for another configuration, or if the
+/// check of the entry doesn't match)
+static num_t lookup_seed_table(const char *path, num_t seed, enum primality_engine primality) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Ignoring the seed table %s, which can't be opened\n", path);
+        return 0;
+    }
+
+    struct seed_table_header header = seed_table_header();
+    size_t size = sizeof(header) + ((size_t)SEED_MAX + 1) * sizeof(seed_table_entry_t);
+    struct stat st;
+    void *table = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == size) {
+        table = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    num_t found_q = 0;
+    if (table != MAP_FAILED) {
+        if (memcmp(table, &header, sizeof(header)) == 0) {
+            seed_table_entry_t entry;
+            memcpy(&entry, (char *)table + sizeof(header) + seed * sizeof(entry), sizeof(entry));
+            if (entry == seed_table_entry(seed, entry & 0xFFFF)) {
+                found_q = (num_t)(seed_min_q(seed) + (entry & 0xFFFF));
+            }
+        }
+        munmap(table, size);
+    }
+
+    // Also check the safe prime itself, which is cheap compared to searching it
+    if (found_q == 0 || !is_sophie_germain_safe_prime(found_q, primality)) {
+        fprintf(stderr, "Ignoring the invalid or outdated seed table %s\n", path);
+        return 0;
+    }
+    return found_q;
+}
+
+/********************************************
+ * WIDE (128-BIT) SOPHIE-GERMAIN SAFE PRIMES *
+ ********************************************/
+
+/// Bound below which the Rabin-Miller test with the witnesses of rm_witnesses (the first 12
+/// primes) is deterministic, that is, 318665857834031151167461
+/// See: https://arxiv.org/abs/1509.00864 (Sorenson & Webster, 2015)
+#define WIDE_RM_DETERMINISTIC_BOUND ((wide_t)UINT64_C(318665857834) * UINT64_C(1000000000000) + \
+                                     UINT64_C(31151167461))
+
+/// Computes the 256-bit product of x and y, returning its lower half and storing its upper
+/// half into *high, from the four 128-bit products of their 64-bit halves
+static wide_t wide_mul_full(wide_t x, wide_t y, wide_t *high) {
+    uint64_t x_low = (uint64_t)x, x_high = (uint64_t)(x >> 64);
+    uint64_t y_low = (uint64_t)y, y_high = (uint64_t)(y >> 64);
+    wide_t low_low = (wide_t)x_low * y_low, low_high = (wide_t)x_low * y_high;
+    wide_t high_low = (wide_t)x_high * y_low, high_high = (wide_t)x_high * y_high;
+
+    // The sum of the three 64-bit terms of the middle can't overflow 128 bits
+    wide_t middle = (low_low >> 64) + (uint64_t)low_high + (uint64_t)high_low;
+    *high = high_high + (low_high >> 64) + (high_low >> 64) + (middle >> 64);
+    return (middle << 64) | (uint64_t)low_low;
+}
+
+/// Same as struct montgomery, for a wide odd modulus (< 2**127), with R = 2**128
+struct wide_montgomery {
+    wide_t modulus;
+    wide_t inverse;
+    wide_t one;
+    wide_t r2;
+};
+
+/// Same as init_montgomery, for a wide odd modulus (< 2**127)
+static struct wide_montgomery init_wide_montgomery(wide_t modulus) {
+    struct wide_montgomery mont;
+    mont.modulus = modulus;
+    mont.inverse = modulus;
+    while (modulus * mont.inverse != 1) {
+        mont.inverse *= 2 - modulus * mont.inverse;
+    }
+
+    // R**2 mod modulus is computed by doubling R mod modulus 128 times,
+    // which can't overflow since the modulus is less than 2**127
+    mont.one = (0 - modulus) % modulus;
+    mont.r2 = mont.one;
+    for (size_t i = 0; i < 128; i++) {
+        mont.r2 *= 2;
+        if (mont.r2 >= modulus) {
+            mont.r2 -= modulus;
+        }
+    }
+    return mont;
+}
+
+/// Same as montgomery_reduce, for the wide t = t_high*R + t_low
+static wide_t wide_montgomery_reduce(const struct wide_montgomery *mont, wide_t t_high, wide_t t_low) {
+    wide_t m = t_low * mont->inverse, mp_high;
+    wide_mul_full(m, mont->modulus, &mp_high);
+    wide_t result = t_high - mp_high;
+    return t_high < mp_high ? result + mont->modulus : result;
+}
+
+/// Same as montgomery_mul, for a wide modulus
+static wide_t wide_montgomery_mul(const struct wide_montgomery *mont, wide_t x, wide_t y) {
+    wide_t high, low = wide_mul_full(x, y, &high);
+    return wide_montgomery_reduce(mont, high, low);
+}
+
+/// Same as montgomery_pow, for a wide modulus
+static wide_t wide_montgomery_pow(const struct wide_montgomery *mont, wide_t x, wide_t y) {
+    wide_t result = mont->one;
+    for (; y > 0; x = wide_montgomery_mul(mont, x, x), y /= 2) {
+        if (y % 2 == 1) {
+            result = wide_montgomery_mul(mont, result, x);
+        }
+    }
+    return result;
+}
+
+/// Same as rm_primality_test, for an odd wide candidate which is greater than the largest
+/// witness, and less than WIDE_RM_DETERMINISTIC_BOUND (so the test is deterministic)
+static bool wide_rm_primality_test(wide_t p_candidate) {
+    struct wide_montgomery mont = init_wide_montgomery(p_candidate);
+    wide_t mont_minus_one = mont.modulus - mont.one;
+    wide_t d = p_candidate - 1;
+    size_t r = 0;
+    while (d % 2 == 0) {
+        r++;
+        d /= 2;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(rm_witnesses); i++) {
+        wide_t x = wide_montgomery_pow(&mont, wide_montgomery_mul(&mont, rm_witnesses[i], mont.r2), d);
+        bool passed = x == mont.one || x == mont_minus_one;
+        for (size_t j = 1; j < r && !passed; j++) {
+            x = wide_montgomery_mul(&mont, x, x);
+            passed = x == mont_minus_one;
+        }
+        if (!passed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Same as is_sophie_germain_safe_prime, for a wide candidate
+static bool wide_is_sophie_germain_safe_prime(wide_t q_candidate) {
+    wide_t p_candidate = (q_candidate - 1) / 2;
+    unsigned max_recip_test = (unsigned)(p_candidate % 20);
+    return (max_recip_test == 3 || max_recip_test == 9 || max_recip_test == 11) &&
+           wide_rm_primality_test(q_candidate) &&
+           wide_rm_primality_test(p_candidate);
+}
+
+/// Same as generate_sophie_germain_safe_prime, for the wide lower bound of a seed of the
+/// wide configuration, using the same wheel and segmented sieve. Since the lower bound
+/// is far greater than the wheel and sieve primes, none of them can be skipped
+static wide_t generate_wide_safe_prime(wide_t lower_bound) {
+    pthread_once(&safe_prime_search_once, init_safe_prime_search);
+
+    size_t wheel_index;
+    wide_t q_candidate = lower_bound + wheel_first_gap((uint32_t)(lower_bound % WHEEL_MODULUS), &wheel_index);
+    uint32_t q_offsets[ARRAY_SIZE(sieve_primes)], p_offsets[ARRAY_SIZE(sieve_primes)];
+    for (size_t i = 0; i < num_sieve_primes; i++) {
+        uint32_t prime = sieve_primes[i];
+        q_offsets[i] = (prime - (uint32_t)(q_candidate % prime)) % prime;
+        p_offsets[i] = (q_offsets[i] + 1) % prime;
+    }
+
+    bool composite[SIEVE_WINDOW_SIZE];
+    for (wide_t window_start = q_candidate; ; window_start += SIEVE_WINDOW_SIZE) {
+        memset(composite, 0, SIEVE_WINDOW_SIZE);
+        for (size_t i = 0; i < num_sieve_primes; i++) {
+            q_offsets[i] = mark_sieve_multiples(composite, SIEVE_WINDOW_SIZE, sieve_primes[i], q_offsets[i]);
+            p_offsets[i] = mark_sieve_multiples(composite, SIEVE_WINDOW_SIZE, sieve_primes[i], p_offsets[i]);
+        }
+
+        for (; q_candidate - window_start < SIEVE_WINDOW_SIZE; ) {
+            if (!composite[(size_t)(q_candidate - window_start)] &&
+                wide_is_sophie_germain_safe_prime(q_candidate)) {
+                return q_candidate;
+            }
+            q_candidate += wheel_gaps[wheel_index];
+            wheel_index = (wheel_index + 1) % num_wheel_residues;
+        }
+    }
+}
+
+/// Same as seed_min_q, for the wide configuration
+static wide_t wide_seed_min_q(uint64_t seed) {
+    return (wide_t)WIDE_NUM_OBSERVATIONS_MAX * NUM_DIGITS_PER_OBSERVATION + 1 +
+           (wide_t)seed * WIDE_PRIME_GERMAIN_GAP_MAX;
+}
+
+/// Same as jump_ahead_remainder, for the wide configuration
+static wide_t wide_jump_ahead_remainder(wide_t found_q, uint64_t observation) {
+    struct wide_montgomery mont = init_wide_montgomery(found_q);
+    wide_t x = wide_montgomery_pow(&mont, wide_montgomery_mul(&mont, 10, mont.r2),
+                                   (wide_t)observation * NUM_DIGITS_PER_OBSERVATION);
+    return wide_montgomery_reduce(&mont, 0, x);
+}
+
+/// Shift of the narrow reciprocal of a wide q (see struct narrow_reciprocal), which is fixed:
+/// since 2**WIDE_RECIPROCAL_SHIFT > q (< 2**69), the quotients are exact up to the correction,
+/// and since r * multiplier < 2**WIDE_RECIPROCAL_SHIFT * 10**NUM_DIGITS_PER_OBSERVATION,
+/// the products fit 128 bits, so the multiplier is computed with a single 128-bit division
+#define WIDE_RECIPROCAL_SHIFT 76
+
+/// Generates the given observations of the decimal expansion of 1/q for a wide q in this
+/// thread, with its narrow reciprocal, which takes a single 128-bit multiplication per
+/// observation, instead of a 128-bit division (a call into the compiler runtime).
+/// Unlike the default configuration, it only uses a single thread. Returns false on failure
+static bool generate_wide_observations(wide_t found_q, enum output_format format,
+                                       uint64_t num_observations, uint64_t offset,
+                                       struct output *output) {
+    assert(found_q < ((wide_t)1 << 69) && "The narrow reciprocal doesn't support the safe prime.");
+    wide_t multiplier = ((wide_t)POW10_DIGITS_PER_OBSERVATION << WIDE_RECIPROCAL_SHIFT) / found_q;
+
+    size_t observation_size = output_format_sizes[format];
+    wide_t r = wide_jump_ahead_remainder(found_q, offset);
+    bool success = true;
+    for (uint64_t i = 0; i < num_observations && success; i++) {
+        wide_t chunk = (r * multiplier) >> WIDE_RECIPROCAL_SHIFT;
+        r = r * POW10_DIGITS_PER_OBSERVATION - chunk * found_q;
+        if (r >= found_q) {
+            chunk++;
+            r -= found_q;
+        }
+        format_observation(format, (num_t)chunk, output_reserve(output, observation_size));
+        success = output_commit(output, observation_size);
+    }
+    return success;
+}
+
+/**************************
+ * COMMAND LINE INTERFACE *
+ **************************/
+
+/// Names of the primality engines, for the command line
+static const char *const primality_engine_names[] = {
+    [PRIMALITY_REFERENCE] = "reference",
+    [PRIMALITY_MINIMAL] = "minimal",
+    [PRIMALITY_BPSW] = "bpsw",
+};
+
+/// Parses the specified string into a number.
+static bool parse_num(const char *str, num_t *dest) {
+    // Don't allow trailing noise. See https://stackoverflow.com/a/21888827
+    char trailing_detect;
+    return sscanf(str, "%" SCNnum "%c", dest, &trailing_detect) == 1;
+}
+
+/// Matches the command line argument at argv[*arg_index] against an option
+/// of the form "--name=value" or "--name value", advancing *arg_index past the
+/// value in the latter case. Returns the value, or NULL if it doesn't match
+static const char *parse_option(int argc, char *argv[], int *arg_index, const char *name) {
+    const char *arg = argv[*arg_index];
+    size_t name_length = strlen(name);
+    if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, name_length) != 0) {
+        return NULL;
+    }
+
+    const char *value = arg + 2 + name_length;
+    if (*value == '=') {
+        return value + 1;
+    }
+    if (*value == '\0' && *arg_index + 1 < argc) {
+        return argv[++*arg_index];
+    }
+    return NULL;
+}
+
+/// Parses the specified string into the index of the matching name of the given list
+static bool parse_name(const char *str, const char *const *names, size_t num_names, size_t *dest) {
+    for (size_t i = 0; i < num_names; i++) {
+        if (strcmp(str, names[i]) == 0) {
+            *dest = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Options of the generator, which are given through the command line
+struct generator_options {
+    /// First observation to be generated
+    num_t offset;
+    /// Number of threads which generate the observations
+    size_t num_threads;
+    enum division_strategy division;
+    enum primality_engine primality;
+    enum output_format format;
+    /// Path of the table of precomputed safe primes for each seed (--table), or NULL, in which
+    /// case they are always searched, so the output never depends on the working directory
+    const char *seed_table_path;
+    /// Whether to try writing the output with vmsplice(2) if it is a pipe
+    bool splice;
+    /// Whether to generate the observations in the pipelined mode
+    bool pipeline;
+    /// Path of the file where the output is written through a memory mapping,
+    /// or NULL to write it to the standard output
+    const char *output_path;
+    /// Format of the report of the statistics of the run, if any
+    enum stats_format stats;
+    /// Path of the file where the state of the run is periodically saved, or NULL
+    const char *checkpoint_path;
+    /// Whether to use the wide configuration, even if the run doesn't exceed the default one
+    bool wide;
+    /// If not zero, the run generates integers in [0, bound) instead of the observations
+    num_t bound;
+    /// Whether the run generates bytes of random bits instead of the observations
+    bool bits;
+    /// Whether the run generates observations until the output is closed (or the period ends),
+    /// instead of a given number of them
+    bool unbounded;
+};
+
+/// Returns the Sophie-Germain safe prime for the given seed, which is looked up
+/// in the table of precomputed safe primes if available, or otherwise searched.
+/// Returns 0 if it isn't valid for the seed (see valid_seed_q), which happens for the few
+/// seeds whose safe prime is beyond NUM_PRIME_GERMAIN_GAP_MAX
+static num_t find_seed_q(num_t seed, const struct generator_options *options) {
+    num_t found_q = options->seed_table_path == NULL ? 0 :
+                    lookup_seed_table(options->seed_table_path, seed, options->primality);
+    if (found_q == 0) {
+        found_q = generate_sophie_germain_safe_prime(seed_min_q(seed), options->primality);
+    }
+    return valid_seed_q(seed, found_q) ? found_q : 0;
+}
+
+/// Number of samples which are generated at once by generate_samples, before they are written
+#define SAMPLE_BLOCK_SIZE 512
+
+/// Writes the decimal digits of the value into dest, without any padding,
+/// and returns how many there are (at most 20)
+static size_t format_integer(uint64_t value, char *dest) {
+    size_t num_digits = 1;
+    for (uint64_t x = value; x >= 10; x /= 10) {
+        num_digits++;
+    }
+    for (size_t j = num_digits; j > 0; j--) {
+        dest[j - 1] = (char)('0' + (int)(value % 10));
+        value /= 10;
+    }
+    return num_digits;
+}
+
+/// Generates num_samples integers in [0, options->bound) (as text lines or native 64-bit
+/// integers, according to the format), or num_samples bytes of random bits if options->bits,
+/// from the expansion of 1/q from the observation options->offset, and writes them into the
+/// given output. They are generated through the generator state of the library, so they are
+/// the same as the ones of sophie_fill_bounded and sophie_fill_bits for the same state.
+/// Stores the number of observations used and of bytes written into the statistics of the run.
+/// Returns false on failure, including when the observations of the expansion are exhausted
+static bool generate_samples(num_t seed, num_t found_q, num_t num_samples,
+                             const struct generator_options *options, struct output *output,
+                             struct run_stats *stats) {
+    struct sophie_state state;
+    if (!init_state(&state, seed, found_q) || !sophie_seek(&state, options->offset)) {
+        return false;
+    }
+
+    bool success = true;
+    stats->num_bytes = 0;
+    for (num_t start = 0; start < num_samples && success; ) {
+        size_t block_size = (size_t)(num_samples - start) < SAMPLE_BLOCK_SIZE ?
+            (size_t)(num_samples - start) : SAMPLE_BLOCK_SIZE;
+        uint64_t samples[SAMPLE_BLOCK_SIZE];
+        if (options->bits) {
+            sophie_fill_bits(&state, (uint8_t *)samples, block_size);
+        } else {
+            sophie_fill_bounded(&state, samples, block_size, options->bound);
+        }
+        // Nothing is written past the observations which are known not to repeat
+        if (state.position > NUM_OBSERVATIONS_MAX) {
+            fprintf(stderr, "The decimal expansion of 1/%" PRInum " is exhausted before generating %"
+                    PRInum " samples\n", found_q, num_samples);
+            success = false;
+            break;
+        }
+
+        if (options->bits) {
+            success = output_write(output, (const char *)samples, block_size);
+            stats->num_bytes += block_size;
+        } else if (options->format == FORMAT_U64) {
+            success = output_write(output, (const char *)samples, block_size * sizeof(uint64_t));
+            stats->num_bytes += block_size * sizeof(uint64_t);
+        } else {
+            for (size_t i = 0; i < block_size && success; i++) {
+                char *line = output_reserve(output, 21);
+                size_t num_digits = format_integer(samples[i], line);
+                line[num_digits] = '\n';
+                success = output_commit(output, num_digits + 1);
+                stats->num_bytes += num_digits + 1;
+            }
+        }
+        start = (num_t)(start + block_size);
+    }
+    stats->num_observations = state.position - options->offset;
+    return success;
+}
+
+/// Generates an uniform sample, using a pseudorandom number generator
+/// based on Sophie-Germain safe primes, with the given options.
+/// Returns false on failure
+static bool generate_uniform_sophie(num_t num_observations, num_t seed,
+                                    const struct generator_options *options) {
+    // Generate the required Sophie-Germain safe prime, unless it is precomputed
+    num_t min_q = seed_min_q(seed);
+    fprintf(stderr, "Looking for a Sophie-Germain safe prime q >= %" PRInum "\n", min_q);
+
+    struct run_stats stats = { 0, monotonic_ns(), 0, 0, num_observations,
+                               num_observations * output_format_sizes[options->format] };
+    num_t found_q = find_seed_q(seed, options);
+    if (found_q == 0) {
+        fprintf(stderr, "No valid Sophie-Germain safe prime for seed %" PRInum " (it is beyond "
+                "q <= %" PRInum ")\n", seed, (num_t)(min_q + NUM_PRIME_GERMAIN_GAP_MAX));
+        return false;
+    }
+    stats.q = found_q;
+    stats.search_ns = monotonic_ns() - stats.search_ns;
+    fprintf(stderr, "Found a Sophie-Germain safe prime q = %" PRInum "\n", found_q);
+
+    // Generate the decimal expansion of 1/q, that is, our random digits
+    fprintf(stderr, "Generating the decimal expansion of 1/%" PRInum "...\n", found_q);
+
+    struct expansion expansion = init_expansion(found_q, options->division);
+    stats.generation_ns = monotonic_ns();
+    struct output output;
+    bool success = true;
+    struct checkpoint checkpoint = { seed, found_q, jump_ahead_remainder(found_q, options->offset),
+                                     options->offset, (num_t)(options->offset + num_observations),
+                                     options->format, output_file_size(STDOUT_FILENO) };
+    if (options->bound != 0 || options->bits) {
+        if (!output_init(&output, STDOUT_FILENO, options->splice)) {
+            return false;
+        }
+        success = generate_samples(seed, found_q, num_observations, options, &output, &stats);
+    } else if (options->output_path != NULL) {
+        success = generate_observations_mapped(&expansion, options->format, num_observations,
+                                               options->offset, options->num_threads,
+                                               options->output_path);
+    } else if (!output_init(&output, STDOUT_FILENO, options->splice)) {
+        return false;
+    } else if (options->checkpoint_path != NULL) {
+        // Save the checkpoint before generating anything, so any interruption can be resumed
+        success = write_checkpoint(options->checkpoint_path, &checkpoint) &&
+                  generate_observations_checkpointed(&expansion, &checkpoint,
+                                                     options->checkpoint_path, &output);
+    } else if (options->unbounded && options->offset >= period_observations(found_q)) {
+        fprintf(stderr, "The offset is beyond the period of 1/%" PRInum ", which has %" PRInum
+                " observations\n", found_q, period_observations(found_q));
+        success = false;
+    } else if (options->unbounded) {
+        fprintf(stderr, "Streaming until the output is closed, or up to %" PRInum " observations\n",
+                (num_t)(period_observations(found_q) - options->offset));
+        success = generate_observations_unbounded(&expansion, options->format, options->offset,
+                                                  &output, &stats.num_observations);
+        stats.num_bytes = stats.num_observations * output_format_sizes[options->format];
+    } else if (options->pipeline) {
+        success = generate_observations_pipelined(&expansion, options->format, num_observations,
+                                                  options->offset, options->num_threads, &output);
+    } else if (options->num_threads > 1) {
+        success = generate_observations_parallel(&expansion, options->format, num_observations,
+                                                 options->offset, options->num_threads, &output);
+    } else {
+        success = generate_observations_serial(&expansion, options->format, num_observations,
+                                               options->offset, &output);
+    }
+
+    if (options->output_path == NULL) {
+        // The output can only be closed by its reader in the --stream mode, which ends there
+        success = success && (output.closed || output_flush(&output));
+        stats.write_ns = output.write_ns;
+        output_free(&output);
+    }
+    stats.generation_ns = monotonic_ns() - stats.generation_ns;
+    if (success && options->stats != STATS_NONE) {
+        print_run_stats(&stats, options->stats);
+    }
+    return success;
+}
+
+/// Checks whether a run is within the limits of the wide configuration
+static bool within_wide_limits(uint64_t num_observations, uint64_t offset, uint64_t seed) {
+    return num_observations <= WIDE_NUM_OBSERVATIONS_MAX - offset && seed <= WIDE_SEED_MAX;
+}
+
+/// Same as generate_uniform_sophie, for the runs which need the wide configuration,
+/// which are generated in this thread into the standard output. Returns false on failure
+static bool generate_uniform_sophie_wide(uint64_t num_observations, uint64_t seed,
+                                         const struct generator_options *options) {
+    assert(wide_seed_min_q(WIDE_SEED_MAX) + WIDE_PRIME_GERMAIN_GAP_MAX < WIDE_RM_DETERMINISTIC_BOUND &&
+           "Invalid configuration: The wide primality test is not deterministic for all the seeds.");
+
+    char buffer[40];
+    wide_t min_q = wide_seed_min_q(seed);
+    fprintf(stderr, "Looking for a wide Sophie-Germain safe prime q >= %s\n", format_wide(min_q, buffer));
+
+    struct run_stats stats = { 0, monotonic_ns(), 0, 0, num_observations,
+                               num_observations * output_format_sizes[options->format] };
+    wide_t found_q = stats.q = generate_wide_safe_prime(min_q);
+    stats.search_ns = monotonic_ns() - stats.search_ns;
+    if (found_q > min_q + WIDE_PRIME_GERMAIN_GAP_MAX) {
+        fprintf(stderr, "No valid wide Sophie-Germain safe prime for seed %" PRIu64 " (it is beyond "
+                "WIDE_PRIME_GERMAIN_GAP_MAX, which is exceeded for this seed)\n", seed);
+        return false;
+    }
+    fprintf(stderr, "Found a wide Sophie-Germain safe prime q = %s\n", format_wide(found_q, buffer));
+    fprintf(stderr, "Generating the decimal expansion of 1/%s...\n", format_wide(found_q, buffer));
+
+    struct output output;
+    if (!output_init(&output, STDOUT_FILENO, options->splice)) {
+        return false;
+    }
+    stats.generation_ns = monotonic_ns();
+    bool success = generate_wide_observations(found_q, options->format, num_observations,
+                                              options->offset, &output) &&
+                   output_flush(&output);
+    stats.write_ns = output.write_ns;
+    stats.generation_ns = monotonic_ns() - stats.generation_ns;
+    output_free(&output);
+    if (success && options->stats != STATS_NONE) {
+        print_run_stats(&stats, options->stats);
+    }
+    return success;
+}
+
+/// Resumes the run saved in the given checkpoint, writing the remaining observations into
+/// the standard output, and saving the checkpoint again as they are written.
+/// Returns false on failure
+static bool resume_uniform_sophie(const char *path, const struct generator_options *options) {
+    struct checkpoint checkpoint;
+    if (!read_checkpoint(path, &checkpoint)) {
+        return false;
+    }
+    fprintf(stderr, "Resuming the decimal expansion of 1/%" PRInum " (seed %" PRInum ") "
+            "at observation %" PRInum " of %" PRInum "...\n",
+            checkpoint.q, checkpoint.seed, checkpoint.next, checkpoint.end);
+
+    // If the output is the one of the interrupted run, discard what was written after the
+    // checkpoint. If it is shorter, it is assumed to be a separate file for the remaining output
+    int64_t output_size = output_file_size(STDOUT_FILENO);
+    if (output_size >= 0) {
+        if (checkpoint.output_size >= 0 && output_size > checkpoint.output_size &&
+            ftruncate(STDOUT_FILENO, (off_t)checkpoint.output_size) != 0) {
+            perror("Failed to truncate the output to the checkpoint");
+            return false;
+        }
+        if (lseek(STDOUT_FILENO, 0, SEEK_END) == -1) {
+            perror("Failed to seek to the end of the output");
+            return false;
+        }
+    }
+
+    struct expansion expansion = init_expansion(checkpoint.q, options->division);
+    struct output output;
+    if (!output_init(&output, STDOUT_FILENO, options->splice)) {
+        return false;
+    }
+    bool success = generate_observations_checkpointed(&expansion, &checkpoint,
+        options->checkpoint_path != NULL ? options->checkpoint_path : path, &output);
+    output_free(&output);
+    return success;
+}
+
+/**************
+ * BATCH MODE *
+ **************/
+
+/// Job of the batch mode, which generates a sample into a file
+struct batch_job {
+    num_t num_observations;
+    num_t seed;
+    char *path;
+    /// Line of the job in the file of jobs
+    size_t line;
+};
+
+/// Jobs of the batch mode, shared by the worker threads, which take them in order
+struct batch {
+    const struct generator_options *options;
+    struct batch_job *jobs;
+    size_t num_jobs;
+    /// Index of the next job to be taken by a worker
+    size_t next_job;
+    /// Number of jobs which have failed
+    size_t num_failed;
+};
+
+/// Reads the jobs of the batch mode, one per line, of the form
+/// "num_observations seed path", where the sample is written into the file at path.
+/// Empty lines and lines starting with '#' are ignored. Returns false on failure
+static bool read_batch_jobs(FILE *file, const struct generator_options *options, struct batch *batch) {
+    char line[4096];
+    size_t capacity = 0, line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[strspn(line, " \t")] == '\0' || line[strspn(line, " \t")] == '#') {
+            continue;
+        }
+
+        struct batch_job job;
+        int path_start = 0;
+        if (sscanf(line, "%" SCNnum " %" SCNnum " %n", &job.num_observations, &job.seed, &path_start) < 2 ||
+            path_start == 0 || line[path_start] == '\0' ||
+            job.num_observations > NUM_OBSERVATIONS_MAX - options->offset || job.seed > SEED_MAX) {
+            fprintf(stderr, "Invalid job at line %zu: %s\n", line_number, line);
+            return false;
+        }
+
+        if (batch->num_jobs == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            struct batch_job *jobs = realloc(batch->jobs, capacity * sizeof(*jobs));
+            if (jobs == NULL) {
+                fprintf(stderr, "Out of memory reading the jobs\n");
+                return false;
+            }
+            batch->jobs = jobs;
+        }
+        job.path = strdup(line + path_start);
+        job.line = line_number;
+        if (job.path == NULL) {
+            fprintf(stderr, "Out of memory reading the jobs\n");
+            return false;
+        }
+        batch->jobs[batch->num_jobs++] = job;
+    }
+    return !ferror(file);
+}
+
+/// Runs a job of the batch mode. Returns false on failure
+static bool run_batch_job(const struct batch_job *job, const struct generator_options *options) {
+    // The safe prime is searched first, so no output file is created for an invalid seed
+    num_t found_q = find_seed_q(job->seed, options);
+    if (found_q == 0) {
+        fprintf(stderr, "No valid Sophie-Germain safe prime for seed %" PRInum "\n", job->seed);
+        return false;
+    }
+
+    int fd = open(job->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        perror("Failed to open the output file");
+        return false;
+    }
+
+    struct expansion expansion = init_expansion(found_q, options->division);
+    struct output output;
+    bool success = output_init(&output, fd, false);
+    if (success) {
+        success = generate_observations_serial(&expansion, options->format, job->num_observations,
+                                               options->offset, &output) &&
+                  output_flush(&output);
+        output_free(&output);
+    }
+    return close(fd) == 0 && success;
+}
+
+/// Entry point of a worker thread of the batch mode, which runs jobs until none is left
+static void *run_batch_worker(void *batch_ptr) {
+    struct batch *batch = batch_ptr;
+    size_t index;
+    while ((index = __atomic_fetch_add(&batch->next_job, 1, __ATOMIC_RELAXED)) < batch->num_jobs) {
+        const struct batch_job *job = &batch->jobs[index];
+        if (!run_batch_job(job, batch->options)) {
+            fprintf(stderr, "The job at line %zu (%s) failed\n", job->line, job->path);
+            __atomic_fetch_add(&batch->num_failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+/// Runs the jobs of the batch mode read from the given file ("-" for the standard input),
+/// in a pool of worker threads. Returns false if any of them fails
+static bool run_batch(const char *path, const struct generator_options *options) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (file == NULL) {
+        perror("Failed to open the file of jobs");
+        return false;
+    }
+
+    struct batch batch = { options, NULL, 0, 0, 0 };
+    bool success = read_batch_jobs(file, options, &batch);
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    if (success) {
+        pthread_t threads[THREADS_MAX];
+        size_t num_started = 0;
+        for (; num_started + 1 < options->num_threads && num_started < batch.num_jobs; num_started++) {
+            if (pthread_create(&threads[num_started], NULL, run_batch_worker, &batch) != 0) {
+                fprintf(stderr, "Failed to create a worker thread\n");
+                break;
+            }
+        }
+        // This thread is a worker too, so the jobs are run even if no thread could be created
+        run_batch_worker(&batch);
+        for (size_t i = 0; i < num_started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+
+        fprintf(stderr, "Ran %zu jobs (%zu failed)\n", batch.num_jobs, batch.num_failed);
+        success = batch.num_failed == 0;
+    }
+
+    for (size_t i = 0; i < batch.num_jobs; i++) {
+        free(batch.jobs[i].path);
+    }
+    free(batch.jobs);
+    return success;
+}
+
+/***************
+ * SERVER MODE *
+ ***************/
+
+/// Ring buffer in shared memory, through which the server passes the output of the requests
+/// of a client. The server only writes the tail and the client only writes the head (both are
+/// byte counts since the connection started), so no locking is needed. The data follows at
+/// SHM_RING_DATA_OFFSET bytes from the start of the ring.
+/// Every side which moves its counter also increments its sequence, which is the futex word
+/// where the other side sleeps while it waits (if it sets its waiting flag)
+struct shm_ring {
+    uint64_t head __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint32_t head_sequence;
+    uint32_t head_waiting;
+    uint64_t tail __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint32_t tail_sequence;
+    uint32_t tail_waiting;
+    uint64_t capacity __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+/// Waits a little for the other end of a shared memory ring to move its counter, whose
+/// sequence was the given one before it was read. First it yields the processor, and after
+/// SHM_RING_SPINS waits, it sleeps on the sequence until it changes (or SHM_RING_SLEEP_NS pass).
+/// The connection is only checked for the other end closing it, since the next requests
+/// are received once the current one is served. Returns false if the other end has closed it
+static bool shm_ring_wait(uint32_t *ring_sequence, uint32_t *ring_waiting, uint32_t sequence,
+                          int socket_fd, unsigned *num_waits) {
+    if ((*num_waits)++ < SHM_RING_SPINS) {
+        sched_yield();
+        return true;
+    }
+
+    // Since the other end increments the sequence before checking the flag, either it wakes
+    // this side, or the sequence already differs and the futex returns at once
+    struct timespec timeout = { 0, SHM_RING_SLEEP_NS };
+    __atomic_store_n(ring_waiting, 1, __ATOMIC_SEQ_CST);
+    long result = syscall(SYS_futex, ring_sequence, FUTEX_WAIT, sequence, &timeout, NULL, 0);
+    __atomic_store_n(ring_waiting, 0, __ATOMIC_RELAXED);
+    if (result == 0 || errno != ETIMEDOUT) {
+        return true;
+    }
+
+    struct pollfd pfd = { socket_fd, POLLRDHUP, 0 };
+    return poll(&pfd, 1, 0) <= 0 || (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR)) == 0;
+}
+
+/// Wakes the other end of a shared memory ring once this side has moved its counter,
+/// if it sleeps on the sequence of the counter
+static void shm_ring_wake(uint32_t *ring_sequence, uint32_t *ring_waiting) {
+    __atomic_add_fetch(ring_sequence, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(ring_waiting, __ATOMIC_SEQ_CST) != 0) {
+        syscall(SYS_futex, ring_sequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+/// Writes the data into the ring (from the server), waiting for the client to read it
+/// if there is not enough space. Returns false if the client has closed the connection.
+/// Since the client can write the whole ring, only the server's own capacity is used, and the
+/// head is clamped to at most the capacity behind the tail, so a client which moves it
+/// anywhere else only corrupts its own output
+static bool shm_ring_write(struct shm_ring *ring, int socket_fd, const char *data, size_t size) {
+    char *ring_data = (char *)ring + SHM_RING_DATA_OFFSET;
+    unsigned num_waits = 0;
+    while (size > 0) {
+        uint32_t head_sequence = __atomic_load_n(&ring->head_sequence, __ATOMIC_SEQ_CST);
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        uint64_t used = tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (used > SHM_RING_CAPACITY) {
+            // The head is ahead of the tail (as if the ring were empty), or too far behind it (full)
+            used = used > UINT64_MAX / 2 ? 0 : SHM_RING_CAPACITY;
+        }
+        uint64_t space = SHM_RING_CAPACITY - used;
+        if (space == 0) {
+            if (!shm_ring_wait(&ring->head_sequence, &ring->head_waiting, head_sequence,
+                               socket_fd, &num_waits)) {
+                return false;
+            }
+            continue;
+        }
+
+        // Write up to the end of the ring, and wrap around in the next iteration
+        size_t position = (size_t)(tail % SHM_RING_CAPACITY);
+        size_t chunk_size = (size_t)(SHM_RING_CAPACITY - position);
+        chunk_size = chunk_size < space ? chunk_size : (size_t)space;
+        chunk_size = chunk_size < size ? chunk_size : size;
+        memcpy(ring_data + position, data, chunk_size);
+        __atomic_store_n(&ring->tail, tail + chunk_size, __ATOMIC_RELEASE);
+        shm_ring_wake(&ring->tail_sequence, &ring->tail_waiting);
+        data += chunk_size;
+        size -= chunk_size;
+        num_waits = 0;
+    }
+    return true;
+}
+
+/// Reads the given amount of data from the ring (from the client) into the output,
+/// waiting for the server to write it. Returns false on failure
+static bool shm_ring_read(struct shm_ring *ring, int socket_fd, size_t size, struct output *output) {
+    const char *ring_data = (const char *)ring + SHM_RING_DATA_OFFSET;
+    unsigned num_waits = 0;
+    while (size > 0) {
+        uint32_t tail_sequence = __atomic_load_n(&ring->tail_sequence, __ATOMIC_SEQ_CST);
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        uint64_t available = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - head;
+        if (available == 0) {
+            if (!shm_ring_wait(&ring->tail_sequence, &ring->tail_waiting, tail_sequence,
+                               socket_fd, &num_waits)) {
+                fprintf(stderr, "The server has closed the connection\n");
+                return false;
+            }
+            continue;
+        }
+
+        size_t position = (size_t)(head % ring->capacity);
+        size_t chunk_size = (size_t)(ring->capacity - position);
+        chunk_size = chunk_size < available ? chunk_size : (size_t)available;
+        chunk_size = chunk_size < size ? chunk_size : size;
+        if (!output_write(output, ring_data + position, chunk_size)) {
+            return false;
+        }
+        __atomic_store_n(&ring->head, head + chunk_size, __ATOMIC_RELEASE);
+        shm_ring_wake(&ring->head_sequence, &ring->head_waiting);
+        size -= chunk_size;
+        num_waits = 0;
+    }
+    return true;
+}
+
+/// Sends a message through the connection, optionally passing a file descriptor along (or -1)
+static bool send_message(int socket_fd, const char *message, int fd) {
+    struct iovec iov = { (void *)message, strlen(message) };
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd != -1) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    return sendmsg(socket_fd, &msg, MSG_NOSIGNAL) == (ssize_t)iov.iov_len;
+}
+
+/// Receives a message from the connection as a string, and the file descriptor passed
+/// along it into *fd (or -1 if there's none, or fd is NULL). Returns false on failure
+/// or if the connection has been closed
+static bool receive_message(int socket_fd, char *message, size_t size, int *fd) {
+    struct iovec iov = { message, size - 1 };
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    ssize_t length = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+    if (length <= 0) {
+        return false;
+    }
+    message[length] = '\0';
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    int received_fd = -1;
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(&received_fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (fd != NULL) {
+        *fd = received_fd;
+    } else if (received_fd != -1) {
+        close(received_fd);
+    }
+    return true;
+}
+
+/// Generator kept resident by the server for a seed, at the position where the last
+/// request for the seed ended, so that a request which continues it needs no jump-ahead
+struct server_generator {
+    /// Sophie-Germain safe prime of the seed, or 0 if it hasn't been searched yet
+    num_t q;
+    num_t position;
+    num_t r;
+};
+
+/// State of the server, shared by the threads which serve each connection
+struct server {
+    const struct generator_options *options;
+    /// Generators of all the seeds, protected by lock
+    struct server_generator *generators;
+    pthread_mutex_t lock;
+};
+
+/// Connection of a client of the server, which is served by its own thread
+struct server_connection {
+    struct server *server;
+    int socket_fd;
+};
+
+/// Serves a request of a client ("seed offset num_observations [format]"), writing its
+/// output into the ring after replying "OK size". Returns false if the connection failed
+static bool serve_request(struct server *server, int socket_fd, struct shm_ring *ring,
+                          const char *request) {
+    num_t seed, offset, num_observations;
+    char format_name[16] = "text";
+    size_t format_index = FORMAT_TEXT;
+    int num_fields = sscanf(request, "%" SCNnum " %" SCNnum " %" SCNnum " %15s",
+                            &seed, &offset, &num_observations, format_name);
+    if (num_fields < 3 || seed > SEED_MAX || offset > NUM_OBSERVATIONS_MAX ||
+        num_observations > NUM_OBSERVATIONS_MAX - offset ||
+        !parse_name(format_name, output_format_names, ARRAY_SIZE(output_format_names), &format_index)) {
+        return send_message(socket_fd, "ERROR Invalid request", -1);
+    }
+    enum output_format format = (enum output_format)format_index;
+
+    // Take the resident generator of the seed, searching its safe prime the first time.
+    // The search is done without holding the lock, so it doesn't stall the other connections
+    // (if two connections search the same seed at once, they find the same safe prime)
+    struct server_generator *generator = &server->generators[seed];
+    pthread_mutex_lock(&server->lock);
+    num_t q = generator->q;
+    pthread_mutex_unlock(&server->lock);
+    if (q == 0) {
+        q = find_seed_q(seed, server->options);
+        if (q == 0) {
+            return send_message(socket_fd, "ERROR No valid safe prime for the seed", -1);
+        }
+        pthread_mutex_lock(&server->lock);
+        if (generator->q == 0) {
+            generator->q = q;
+            generator->position = 0;
+            generator->r = 1;
+        }
+        pthread_mutex_unlock(&server->lock);
+    }
+
+    // Take the remainder at the offset from the generator (or jump to it), and advance the
+    // generator past the observations of the request, all in the same critical section, so
+    // the concurrent requests for the seed don't lose its updates. Its remainder at the end
+    // of them is 10**(num_observations*NUM_DIGITS_PER_OBSERVATION) times the one at the
+    // offset (mod q), so it is known before they are generated (out of the lock)
+    struct montgomery mont = init_montgomery(q);
+    num_t advance = pow10_observations_mod(q, num_observations);
+    pthread_mutex_lock(&server->lock);
+    num_t r = generator->position == offset ? generator->r : jump_ahead_remainder(q, offset);
+    generator->position = (num_t)(offset + num_observations);
+    generator->r = montgomery_mul(&mont, montgomery_from(&mont, r), advance);
+    pthread_mutex_unlock(&server->lock);
+
+    char reply[64];
+    size_t observation_size = output_format_sizes[format];
+    snprintf(reply, sizeof(reply), "OK %zu", (size_t)num_observations * observation_size);
+    if (!send_message(socket_fd, reply, -1)) {
+        return false;
+    }
+
+    struct expansion expansion = init_expansion(q, server->options->division);
+    char buffer[OUTPUT_RESERVE_MAX];
+    size_t buffer_size = 0;
+    for (num_t i = 0; i < num_observations; i++) {
+        format_observation(format, extract_observation(&expansion, &r), buffer + buffer_size);
+        buffer_size += observation_size;
+        if (buffer_size + observation_size > sizeof(buffer) || i + 1 == num_observations) {
+            if (!shm_ring_write(ring, socket_fd, buffer, buffer_size)) {
+                return false;
+            }
+            buffer_size = 0;
+        }
+    }
+    return true;
+}
+
+/// Entry point of the thread which serves a connection. It creates the shared memory ring,
+/// passes it to the client ("RING capacity"), and then serves its requests until it closes
+static void *serve_connection(void *connection_ptr) {
+    struct server_connection *connection = connection_ptr;
+    int socket_fd = connection->socket_fd;
+    struct server *server = connection->server;
+    free(connection);
+
+    // The shared memory object is unlinked right away, since it is passed through the connection
+    char shm_name[64];
+    static unsigned long shm_counter;
+    snprintf(shm_name, sizeof(shm_name), "/sophie-%ld-%lu", (long)getpid(),
+             __atomic_fetch_add(&shm_counter, 1, __ATOMIC_RELAXED));
+    int shm_fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    size_t shm_size = SHM_RING_DATA_OFFSET + SHM_RING_CAPACITY;
+    struct shm_ring *ring = MAP_FAILED;
+    if (shm_fd != -1) {
+        shm_unlink(shm_name);
+        if (ftruncate(shm_fd, (off_t)shm_size) == 0) {
+            ring = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        }
+    }
+
+    if (ring != MAP_FAILED) {
+        ring->capacity = SHM_RING_CAPACITY;
+        char message[256];
+        snprintf(message, sizeof(message), "RING %zu", SHM_RING_CAPACITY);
+        bool connected = send_message(socket_fd, message, shm_fd);
+        while (connected && receive_message(socket_fd, message, sizeof(message), NULL)) {
+            connected = serve_request(server, socket_fd, ring, message);
+        }
+        munmap(ring, shm_size);
+    } else {
+        perror("Failed to create the shared memory ring");
+    }
+
+    if (shm_fd != -1) {
+        close(shm_fd);
+    }
+    close(socket_fd);
+    return NULL;
+}
+
+/// Runs the server, which listens on the given Unix socket path, and serves each
+/// connection in its own thread until it is killed. Returns false on failure
+static bool run_server(const char *path, const struct generator_options *options) {
+    struct server server;
+    server.options = options;
+    server.generators = calloc((size_t)SEED_MAX + 1, sizeof(*server.generators));
+    if (server.generators == NULL) {
+        fprintf(stderr, "Out of memory allocating the generators of the server\n");
+        return false;
+    }
+    pthread_mutex_init(&server.lock, NULL);
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (strlen(path) >= sizeof(address.sun_path) || listen_fd == -1) {
+        fprintf(stderr, "Failed to create the socket %s\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0) {
+        perror("Failed to listen on the socket");
+        close(listen_fd);
+        return false;
+    }
+    fprintf(stderr, "Listening on %s\n", path);
+
+    for (;;) {
+        int socket_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (socket_fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("Failed to accept a connection");
+            close(listen_fd);
+            return false;
+        }
+
+        pthread_t thread;
+        pthread_attr_t attr;
+        struct server_connection *connection = malloc(sizeof(*connection));
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (connection == NULL) {
+            close(socket_fd);
+        } else {
+            connection->server = &server;
+            connection->socket_fd = socket_fd;
+            if (pthread_create(&thread, &attr, serve_connection, connection) != 0) {
+                fprintf(stderr, "Failed to create a thread for a connection\n");
+                close(socket_fd);
+                free(connection);
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+}
+
+/// Requests a sample to the server listening on the given Unix socket path, and writes
+/// it to the standard output, as if it had been generated by this process
+static bool request_server(const char *path, num_t num_observations, num_t seed,
+                           const struct generator_options *options) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    int socket_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (strlen(path) >= sizeof(address.sun_path) || socket_fd == -1) {
+        fprintf(stderr, "Failed to create the socket %s\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+    if (connect(socket_fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("Failed to connect to the server");
+        close(socket_fd);
+        return false;
+    }
+
+    // Map the ring which is passed by the server, and send the request
+    char message[256];
+    int shm_fd = -1;
+    size_t capacity = 0, size = 0;
+    struct shm_ring *ring = MAP_FAILED;
+    if (receive_message(socket_fd, message, sizeof(message), &shm_fd) &&
+        sscanf(message, "RING %zu", &capacity) == 1 && shm_fd != -1) {
+        ring = mmap(NULL, SHM_RING_DATA_OFFSET + capacity, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    }
+    if (shm_fd != -1) {
+        close(shm_fd);
+    }
+    snprintf(message, sizeof(message), "%" PRInum " %" PRInum " %" PRInum " %s",
+             seed, options->offset, num_observations, output_format_names[options->format]);
+    if (ring == MAP_FAILED || !send_message(socket_fd, message, -1) ||
+        !receive_message(socket_fd, message, sizeof(message), NULL) ||
+        sscanf(message, "OK %zu", &size) != 1) {
+        fprintf(stderr, "The request to the server failed%s%s\n",
+                strncmp(message, "ERROR ", 6) == 0 ? ": " : "",
+                strncmp(message, "ERROR ", 6) == 0 ? message + 6 : "");
+        if (ring != MAP_FAILED) {
+            munmap(ring, SHM_RING_DATA_OFFSET + capacity);
+        }
+        close(socket_fd);
+        return false;
+    }
+
+    struct output output;
+    bool success = output_init(&output, STDOUT_FILENO, options->splice);
+    if (success) {
+        success = shm_ring_read(ring, socket_fd, size, &output) && output_flush(&output);
+        output_free(&output);
+    }
+    munmap(ring, SHM_RING_DATA_OFFSET + capacity);
+    close(socket_fd);
+    return success;
+}
+
+/// Entry point of the application. Parses the command line inputs and calls the generator
+int main(int argc, char *argv[]) {
+    check_configuration();
+
+    // Print title, check and validate command line arguments
+    fprintf(stderr, "PRNG Based on Sophie-Germain primes\n");
+    fprintf(stderr, "-----------------------------------\n");
+
+    bool valid_options = true;
+    struct generator_options options = {
+        .offset = 0,
+        .num_threads = 1,
+        .division = DIVISION_RECIPROCAL,
+        .primality = PRIMALITY_MINIMAL,
+        .format = FORMAT_TEXT,
+        .seed_table_path = NULL,
+        .splice = false,
+        .pipeline = false,
+        .output_path = NULL,
+        .stats = STATS_NONE,
+        .checkpoint_path = NULL,
+        .wide = false,
+        .bound = 0,
+        .bits = false,
+        .unbounded = false,
+    };
+    const char *write_table_path = NULL, *server_path = NULL, *connect_path = NULL, *batch_path = NULL;
+    const char *resume_path = NULL;
+    int arg_index = 1;
+    for (; arg_index < argc && strncmp(argv[arg_index], "--", 2) == 0; arg_index++) {
+        const char *value;
+        num_t num_value = 0;
+        size_t name_index = 0;
+        if ((value = parse_option(argc, argv, &arg_index, "offset")) != NULL) {
+            valid_options = valid_options && parse_num(value, &options.offset);
+        } else if ((value = parse_option(argc, argv, &arg_index, "threads")) != NULL) {
+            valid_options = valid_options && parse_num(value, &num_value) &&
+                            num_value >= 1 && num_value <= THREADS_MAX;
+            options.num_threads = (size_t)num_value;
+        } else if ((value = parse_option(argc, argv, &arg_index, "division")) != NULL) {
+            valid_options = valid_options && parse_name(value, division_strategy_names,
+                ARRAY_SIZE(division_strategy_names), &name_index);
+            options.division = (enum division_strategy)name_index;
+        } else if ((value = parse_option(argc, argv, &arg_index, "primality")) != NULL) {
+            valid_options = valid_options && parse_name(value, primality_engine_names,
+                ARRAY_SIZE(primality_engine_names), &name_index);
+            options.primality = (enum primality_engine)name_index;
+        } else if ((value = parse_option(argc, argv, &arg_index, "format")) != NULL) {
+            valid_options = valid_options && parse_name(value, output_format_names,
+                ARRAY_SIZE(output_format_names), &name_index);
+            options.format = (enum output_format)name_index;
+        } else if (strcmp(argv[arg_index], "--splice") == 0) {
+            options.splice = true;
+        } else if (strcmp(argv[arg_index], "--pipeline") == 0) {
+            options.pipeline = true;
+        } else if (strcmp(argv[arg_index], "--wide") == 0) {
+            options.wide = true;
+        } else if ((value = parse_option(argc, argv, &arg_index, "bound")) != NULL) {
+            valid_options = valid_options && parse_num(value, &options.bound) && options.bound != 0;
+        } else if (strcmp(argv[arg_index], "--bits") == 0) {
+            options.bits = true;
+        } else if (strcmp(argv[arg_index], "--stream") == 0) {
+            options.unbounded = true;
+        } else if (strcmp(argv[arg_index], "--stats") == 0) {
+            options.stats = STATS_TEXT;
+        } else if (strncmp(argv[arg_index], "--stats=", strlen("--stats=")) == 0) {
+            // Unlike other options, the value can't be the next argument, since it's optional
+            valid_options = valid_options && parse_name(argv[arg_index] + strlen("--stats="),
+                stats_format_names, ARRAY_SIZE(stats_format_names), &name_index);
+            options.stats = (enum stats_format)name_index;
+        } else if ((value = parse_option(argc, argv, &arg_index, "output")) != NULL) {
+            options.output_path = value;
+        } else if ((value = parse_option(argc, argv, &arg_index, "table")) != NULL) {
+            options.seed_table_path = value;
+        } else if ((value = parse_option(argc, argv, &arg_index, "write-table")) != NULL) {
+            write_table_path = value;
+        } else if ((value = parse_option(argc, argv, &arg_index, "server")) != NULL) {
+            server_path = value;
+        } else if ((value = parse_option(argc, argv, &arg_index, "connect")) != NULL) {
+            connect_path = value;
+        } else if ((value = parse_option(argc, argv, &arg_index, "batch")) != NULL) {
+            batch_path = value;
+        } else if ((value = parse_option(argc, argv, &arg_index, "checkpoint")) != NULL) {
+            options.checkpoint_path = value;
+        } else if ((value = parse_option(argc, argv, &arg_index, "resume")) != NULL) {
+            resume_path = value;
+        } else {
+            valid_options = false;
+        }
+    }
+
+    // Checkpoints are only saved, and the wide configuration is only available,
+    // when generating in this thread into the standard output
+    bool other_mode = write_table_path != NULL || server_path != NULL || batch_path != NULL ||
+                      connect_path != NULL;
+    bool checkpointed = options.checkpoint_path != NULL || resume_path != NULL;
+    bool wide = options.wide;
+    if ((checkpointed || wide) && (other_mode || options.num_threads > 1 || options.pipeline ||
+                                   options.output_path != NULL)) {
+        valid_options = false;
+    }
+    if (checkpointed && wide) {
+        valid_options = false;
+    }
+    // Likewise for the samples, which are integers (as text lines or u64) or bytes of bits
+    bool sampled = options.bound != 0 || options.bits;
+    if (sampled && (other_mode || checkpointed || wide || options.num_threads > 1 ||
+                    options.pipeline || options.output_path != NULL ||
+                    (options.bound != 0 && options.bits) ||
+                    (options.format != FORMAT_TEXT && (options.bits || options.format != FORMAT_U64)))) {
+        valid_options = false;
+    }
+    // The stream has no end, so it is generated in this thread into the standard output too,
+    // and its offset is only bounded by the period of the expansion (checked once q is found)
+    // The client only forwards the offset and the format to the server (and writes the output
+    // into the standard output), so the options of the local generation are rejected
+    if (connect_path != NULL && (options.num_threads > 1 || options.pipeline ||
+                                 options.output_path != NULL || options.stats != STATS_NONE)) {
+        valid_options = false;
+    }
+    if (options.unbounded && (sampled || other_mode || checkpointed || options.wide ||
+                              options.num_threads > 1 || options.pipeline ||
+                              options.output_path != NULL)) {
+        valid_options = false;
+    }
+    if (valid_options && resume_path != NULL && arg_index == argc) {
+        return resume_uniform_sophie(resume_path, &options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (valid_options && write_table_path != NULL && arg_index == argc) {
+        return write_seed_table(write_table_path, options.primality, options.num_threads) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (valid_options && server_path != NULL && write_table_path == NULL && arg_index == argc) {
+        return run_server(server_path, &options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (valid_options && batch_path != NULL && server_path == NULL && write_table_path == NULL &&
+        arg_index == argc) {
+        return run_batch(batch_path, &options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    num_t num_observations = 0, seed = 0;
+    bool valid_run = valid_options && write_table_path == NULL && server_path == NULL &&
+                     batch_path == NULL && resume_path == NULL && argc - arg_index == 2 &&
+                     parse_num(argv[arg_index], &num_observations) &&
+                     parse_num(argv[arg_index + 1], &seed);
+    if (valid_options && options.unbounded) {
+        valid_run = argc - arg_index == 1 && parse_num(argv[arg_index], &seed) && seed <= SEED_MAX;
+    }
+
+    // The runs which exceed the limits of the default configuration need --wide, since the
+    // wide configuration generates a different sample, which doesn't continue the default one
+    if (valid_run && !wide && !options.unbounded &&
+        (options.offset > NUM_OBSERVATIONS_MAX || num_observations > NUM_OBSERVATIONS_MAX - options.offset ||
+         seed > SEED_MAX)) {
+        valid_run = false;
+    }
+    if (valid_run && wide) {
+        valid_run = within_wide_limits(num_observations, options.offset, seed);
+    }
+
+    if (!valid_run) {
+        fprintf(stderr, "Usage: %s [options] num_observations seed\n", argv[0]);
+        fprintf(stderr, "       %s [--primality engine] [--threads n] --write-table file\n", argv[0]);
+        fprintf(stderr, "       %s [options] --server socket\n", argv[0]);
+        fprintf(stderr, "       %s [options] --batch file (with lines: num_observations seed path)\n", argv[0]);
+        fprintf(stderr, "       %s [--division strategy] [--splice] [--checkpoint file] --resume file\n", argv[0]);
+        fprintf(stderr, "       %s [--offset k] [--format format] [--division strategy] [--splice] [--stats]"
+                " --stream seed\n", argv[0]);
+        fprintf(stderr, "    (where offset + num_observations <= %" PRInum ")\n", NUM_OBSERVATIONS_MAX);
+        fprintf(stderr, "    (where seed <= %" PRInum ")\n", SEED_MAX);
+        fprintf(stderr, "    (or up to %" PRIu64 " and %" PRIu64 " with the wide configuration (--wide),\n"
+                "     which only supports the options offset, format, splice and stats)\n",
+                WIDE_NUM_OBSERVATIONS_MAX, WIDE_SEED_MAX);
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "    --offset k: Start at observation k (default: 0)\n");
+        fprintf(stderr, "    --threads n: Generate using n <= %d threads (default: 1)\n", THREADS_MAX);
+        fprintf(stderr, "    --division strategy: digit, chunk or reciprocal (default)\n");
+        fprintf(stderr, "    --primality engine: reference, minimal (default) or bpsw\n");
+        fprintf(stderr, "    --format format: text (default), f64, u64 or digits\n");
+        fprintf(stderr, "    --splice: Write the output with vmsplice if it is a pipe\n");
+        fprintf(stderr, "    --pipeline: Generate with --threads threads while writing on another\n");
+        fprintf(stderr, "    --wide: Use the wide configuration, which generates a different sample\n");
+        fprintf(stderr, "    --bound n: Generate integers in [0, n), as text (default) or u64\n");
+        fprintf(stderr, "    --bits: Generate num_observations bytes of random bits\n");
+        fprintf(stderr, "    --stream: Generate until the output is closed, or the period of 1/q ends\n");
+        fprintf(stderr, "    --output file: Write the output into a file through a memory mapping\n");
+        fprintf(stderr, "    --stats[=format]: Report the statistics of the run, as text (default) or json\n");
+        fprintf(stderr, "    --checkpoint file: Periodically save the state of the run, to --resume it\n");
+        fprintf(stderr, "    --connect socket: Request the sample to the server on the given socket\n");
+        fprintf(stderr, "    --table file: Precomputed safe prime table (e.g. sophie.table, see make table)\n");
+        return EXIT_FAILURE;
+    }
+
+    // Once we have a valid parametrization, run the core algorithm
+    if (options.unbounded) {
+        // A closed pipe is detected by the writes failing with EPIPE, instead of a signal
+        signal(SIGPIPE, SIG_IGN);
+    }
+    if (connect_path != NULL) {
+        return request_server(connect_path, num_observations, seed, &options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (wide) {
+        return generate_uniform_sophie_wide(num_observations, seed, &options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    return generate_uniform_sophie(num_observations, seed, &options) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,174 @@
+/* MIT License
+
+Copyright (c) 2019 Joan Bruguera Micó
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+/// Library interface of the pseudorandom number generator based on
+/// Sophie-Germain safe primes (libsophie, built from sophie.c)
+#ifndef SOPHIE_H
+#define SOPHIE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// State of a generator, that is, its position in the decimal expansion of 1/q,
+/// where q is the Sophie-Germain safe prime of its seed.
+/// The generated observations are the same as the ones of the command line program
+/// for the same seed. The fields must not be modified directly
+struct sophie_state {
+    /// Sophie-Germain safe prime of the seed
+    uint64_t q;
+    /// Remainder of the long division of 1/q right before the next observation
+    uint64_t r;
+    /// Index (zero-based) of the next observation
+    uint64_t position;
+    /// Precomputed reciprocal of q, to extract the digits without hardware division
+    uint64_t reciprocal_divisor;
+    uint64_t reciprocal_inverse;
+    unsigned reciprocal_shift;
+    /// Random bits extracted from the observations, which are not returned yet, and their count
+    uint64_t bits;
+    unsigned num_bits;
+};
+
+/// Index of the decimal expansion of 1/q for a seed, which gives any of its observations in
+/// constant time (see sophie_at). The observations are split into blocks of block_size, and
+/// the index holds the remainder of the long division at the start of every block, and the
+/// factor which advances a remainder to every offset within a block, thus it takes
+/// (sophie_observations_max() / block_size + block_size) * 8 bytes.
+/// It is not modified by sophie_at, so it can be shared by any number of threads.
+/// The fields must not be modified directly
+struct sophie_index {
+    /// Sophie-Germain safe prime of the seed
+    uint64_t q;
+    /// Number of observations per block, and number of blocks
+    uint64_t block_size;
+    uint64_t num_blocks;
+    /// Remainders at the start of every block (in Montgomery form), and 10**(offset*digits)
+    /// mod q for every offset within a block, in the same allocation
+    uint64_t *block_remainders;
+    uint64_t *offset_factors;
+    /// Precomputed data for the Montgomery multiplication modulo q
+    uint64_t montgomery_inverse;
+    /// Precomputed reciprocal of q, to extract the digits without hardware division
+    uint64_t reciprocal_divisor;
+    uint64_t reciprocal_inverse;
+    unsigned reciprocal_shift;
+};
+
+/// Returns the maximum seed which may be accepted by sophie_init. Not every seed up to it is
+/// accepted: the few whose safe prime is beyond the gap of the configuration (e.g. 5287 and
+/// 52091) have none, so callers must check the result of sophie_init for each seed
+uint64_t sophie_seed_max(void);
+
+/// Returns the number of observations which are guaranteed to be generated
+/// for every seed before its decimal expansion repeats
+uint64_t sophie_observations_max(void);
+
+/// Initializes the generator state for the given seed, at the first observation.
+/// This searches the Sophie-Germain safe prime of the seed, which takes some microseconds.
+/// Returns false if the seed is greater than sophie_seed_max(), or if the seed has no valid
+/// safe prime (see sophie_seed_max), in which case the state must not be used
+bool sophie_init(struct sophie_state *state, uint64_t seed);
+
+/// Initializes the generator states of num_seeds consecutive seeds, starting from first_seed,
+/// as sophie_init does, searching their safe primes in parallel with num_threads threads.
+/// Returns false if any of the seeds is greater than sophie_seed_max() or has no valid safe
+/// prime (so the whole range fails if it contains one of those), or if the threads can't
+/// be created. The states must not be used if it fails
+bool sophie_init_seeds(struct sophie_state *states, uint64_t first_seed, size_t num_seeds,
+                       size_t num_threads);
+
+/// Moves the generator to the given observation (zero-based) in O(log position) time,
+/// discarding the random bits which are not returned yet (see sophie_next_bits).
+/// Returns false if the position is greater than sophie_observations_max()
+bool sophie_seek(struct sophie_state *state, uint64_t position);
+
+/// Returns the next observation as an integer with its decimal digits,
+/// that is, the observation multiplied by 10**15 (10**digits per observation)
+uint64_t sophie_next_u64(struct sophie_state *state);
+
+/// Returns the next observation as a double in [0, 1)
+double sophie_next_double(struct sophie_state *state);
+
+/// Fills the buffer with the next n observations, as sophie_next_u64 does
+void sophie_fill_u64(struct sophie_state *state, uint64_t *buf, size_t n);
+
+/// Fills the buffer with the next n observations, as sophie_next_double does
+void sophie_fill_f64(struct sophie_state *state, double *buf, size_t n);
+
+/// Returns the next num_bits (at most 64) uniformly distributed random bits, in the lowest bits.
+/// The bits are extracted exactly from the digits of the observations (about 48 bits per
+/// observation), and the ones which are not returned yet are kept for the next calls.
+/// The functions returning whole observations don't use those, so they stay for later calls
+uint64_t sophie_next_bits(struct sophie_state *state, unsigned num_bits);
+
+/// Returns the next integer in [0, bound), uniformly distributed and without any bias,
+/// or in [0, 2**64) if the bound is 0. It takes 32 random bits (see sophie_next_bits) if the
+/// bound fits 32 bits, or 64 otherwise, which are multiplied by the bound, and rejected
+/// (with probability less than bound / 2**32 or bound / 2**64) if they would be biased.
+/// See: https://arxiv.org/abs/1805.10941 (Lemire, Fast Random Integer Generation in an Interval)
+uint64_t sophie_next_bounded(struct sophie_state *state, uint64_t bound);
+
+/// Fills the buffer with the next n integers in [0, bound), as sophie_next_bounded does
+void sophie_fill_bounded(struct sophie_state *state, uint64_t *buf, size_t n, uint64_t bound);
+
+/// Fills the buffer with the next n bytes of random bits (see sophie_next_bits),
+/// where the first bit of every byte is its lowest one
+void sophie_fill_bits(struct sophie_state *state, uint8_t *buf, size_t n);
+
+/// Builds the index of the expansion of the given seed with blocks of block_size observations
+/// (or about the square root of sophie_observations_max() if 0, which takes the least memory),
+/// which takes O(sophie_observations_max() / block_size + block_size) time.
+/// Returns false if the seed is greater than sophie_seed_max() or has no valid safe prime
+/// (see sophie_seed_max), if the block size is greater than sophie_observations_max(),
+/// or if the index can't be allocated
+bool sophie_index_init(struct sophie_index *index, uint64_t seed, uint64_t block_size);
+
+/// Frees the memory of an index built by sophie_index_init
+void sophie_index_free(struct sophie_index *index);
+
+/// Stores the observation at the given position (zero-based) of the index, as sophie_next_u64
+/// would return it after sophie_seek(position), into *observation, with two lookups into the
+/// index, one modular multiplication and the extraction of a single observation.
+/// Returns false if the position is not less than sophie_observations_max()
+bool sophie_at(const struct sophie_index *index, uint64_t position, uint64_t *observation);
+
+/// Same as sophie_at, but as sophie_next_double does
+bool sophie_at_double(const struct sophie_index *index, uint64_t position, double *observation);
+
+/// Fills bufs[j] with the next n observations of states[j], for each of the num_states
+/// generator states, as sophie_fill_u64 does. The generators are advanced together,
+/// in the lanes of vector instructions, so this is much faster than filling them one by one
+void sophie_fill_streams_u64(struct sophie_state *states, size_t num_states,
+                             uint64_t *const *bufs, size_t n);
+
+/// Same as sophie_fill_streams_u64, but as sophie_fill_f64 does
+void sophie_fill_streams_f64(struct sophie_state *states, size_t num_states,
+                             double *const *bufs, size_t n);
+
+/// Returns the name of the variant of the vector instructions used by sophie_fill_streams_u64
+/// and sophie_fill_streams_f64, which is the widest one supported by the running CPU
+/// ("avx512", "avx2" or "sse2" on x86, or "generic"), and stores into *num_lanes (unless NULL)
+/// how many generators it advances at once
+const char *sophie_stream_kernel(size_t *num_lanes);
+
+#endif